@@ -0,0 +1,545 @@
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "archive.h"
+#include "mapfile.h"
+#include "gear.h"
+
+#define ARCHIVE_SEGMENT_CHUNKS (ARCHIVE_SEGMENT_SIZE / ARCHIVE_MIN_CHUNK + 1)
+
+// Segments chunked per pool run, enough to keep every worker busy while
+// the chunk records stay small
+#define ARCHIVE_BATCH_PER_THREAD 4
+
+typedef struct {
+    u8* data;
+    u64 size;
+    u64 hash[2];
+} archive_chunk;
+
+typedef struct {
+    u8* data;
+    u64 size;
+    u32 file;
+    u64 num_chunks;
+} archive_segment;
+
+typedef struct {
+    archive_segment* segments;
+    archive_chunk* chunks; // ARCHIVE_SEGMENT_CHUNKS per segment
+    u64* gear;
+} chunk_job;
+
+typedef struct {
+    u64 hash[2];
+    u32 unique;
+    b32 used;
+} dedupe_entry;
+
+#define ARCHIVE_DEDUPE_MIN_ENTRIES KiB(64)
+
+// Open addressing on the first half of the hash, doubled at half load
+typedef struct {
+    dedupe_entry* entries;
+    u64 mask;
+    u64 count;
+} dedupe_table;
+
+static inline u64 rotl64(u64 x, u32 r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline u64 fmix64(u64 k) {
+    k ^= k >> 33;
+    k *= 0xFF51AFD7ED558CCDull;
+    k ^= k >> 33;
+    k *= 0xC4CEB9FE1A85EC53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+// MurmurHash3 x64 128. Not cryptographic, matching chunks are compared
+// byte by byte before they are shared.
+static void chunk_hash(u8* data, u64 size, u64* out) {
+    const u64 c1 = 0x87C37B91114253D5ull;
+    const u64 c2 = 0x4CF5AD432745937Full;
+    u64 h1 = 0;
+    u64 h2 = 0;
+
+    u64 num_blocks = size / 16;
+    for (u64 i = 0; i < num_blocks; i++) {
+        u64 k1, k2;
+        memcpy(&k1, data + i * 16, sizeof(k1));
+        memcpy(&k2, data + i * 16 + 8, sizeof(k2));
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52DCE729;
+
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495AB5;
+    }
+
+    u8* tail = data + num_blocks * 16;
+    u64 rest = size & 15;
+    u64 k1 = 0;
+    u64 k2 = 0;
+
+    for (u64 j = rest; j > 8; j--) { k2 ^= (u64)tail[j - 1] << ((j - 9) * 8); }
+    if (rest > 8) { k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2; }
+
+    for (u64 j = MIN(rest, 8); j > 0; j--) { k1 ^= (u64)tail[j - 1] << ((j - 1) * 8); }
+    if (rest > 0) { k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1; }
+
+    h1 ^= size;
+    h2 ^= size;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    out[0] = h1;
+    out[1] = h2;
+}
+
+static void chunk_segment_task(void* ctx, u64 index, mem_arena* arena) {
+    (void)arena;
+
+    chunk_job* job = (chunk_job*)ctx;
+    archive_segment* seg = &job->segments[index];
+    archive_chunk* chunks = job->chunks + index * ARCHIVE_SEGMENT_CHUNKS;
+    u64* gear = job->gear;
+    u8* data = seg->data;
+
+    u64 num_chunks = 0;
+    u64 start = 0;
+
+    while (start < seg->size) {
+        u64 end = MIN(start + ARCHIVE_MAX_CHUNK, seg->size);
+        u64 cut = end;
+        u64 i = start + ARCHIVE_MIN_CHUNK;
+
+        if (i < end) {
+            u64 hash = 0;
+            // The hash only sees GEAR_WINDOW bytes, so it can start that
+            // far before the minimum size
+            for (u64 j = i - GEAR_WINDOW; j < i; j++) { hash = gear_update(hash, gear, data[j]); }
+
+            for (; i < end; i++) {
+                hash = gear_update(hash, gear, data[i]);
+                if ((hash >> (64 - ARCHIVE_CHUNK_BITS)) == 0) {
+                    cut = i + 1;
+                    break;
+                }
+            }
+        }
+
+        archive_chunk* c = &chunks[num_chunks++];
+        c->data = data + start;
+        c->size = cut - start;
+        chunk_hash(c->data, c->size, c->hash);
+
+        start = cut;
+    }
+
+    seg->num_chunks = num_chunks;
+}
+
+static dedupe_entry* dedupe_slot(dedupe_table* t, u64* hash) {
+    u64 i = hash[0] & t->mask;
+    while (t->entries[i].used && (t->entries[i].hash[0] != hash[0] || t->entries[i].hash[1] != hash[1])) {
+        i = (i + 1) & t->mask;
+    }
+
+    return &t->entries[i];
+}
+
+static b32 dedupe_grow(mem_arena* arena, dedupe_table* t) {
+    u64 capacity = (t->mask + 1) * 2;
+    dedupe_entry* entries = PUSH_ARRAY(arena, dedupe_entry, capacity);
+    if (entries == NULL) { return false; }
+
+    dedupe_table grown = { .entries = entries, .mask = capacity - 1, .count = t->count };
+    for (u64 i = 0; i <= t->mask; i++) {
+        if (t->entries[i].used) { *dedupe_slot(&grown, t->entries[i].hash) = t->entries[i]; }
+    }
+
+    *t = grown;
+    return true;
+}
+
+// Empty files cannot be mapped, they and anything else mapping refuses
+// are read with stdio
+static b32 load_input(mem_arena* arena, const char* filename, file_map* map, u8** data, u64* size) {
+    if (file_map_open(map, filename)) {
+        *data = map->data;
+        *size = map->size;
+        return true;
+    }
+
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) { return false; }
+
+    b32 ok = fseek(f, 0, SEEK_END) == 0;
+    long end = ok ? ftell(f) : -1;
+    ok = end >= 0 && fseek(f, 0, SEEK_SET) == 0;
+
+    if (ok) {
+        *size = (u64)end;
+        *data = PUSH_ARRAY_NZ(arena, u8, *size);
+        ok = *data != NULL && fread(*data, 1, *size, f) == *size;
+    }
+
+    fclose(f);
+    return ok;
+}
+
+// Relative, without ".." and without drive letters
+static b32 safe_name(const char* name, u64 size) {
+    if (size == 0 || name[0] == '/' || name[0] == '\\') { return false; }
+
+    u64 part_start = 0;
+    for (u64 i = 0; i <= size; i++) {
+        if (i < size && (name[i] == '\0' || name[i] == ':')) { return false; }
+
+        if (i == size || name[i] == '/' || name[i] == '\\') {
+            if (i - part_start == 2 && name[part_start] == '.' && name[part_start + 1] == '.') { return false; }
+            part_start = i + 1;
+        }
+    }
+
+    return true;
+}
+
+static void make_dir(const char* path) {
+#if defined(_WIN32)
+    _mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+}
+
+// Creates every directory on the way to the file at path
+static void make_parent_dirs(char* path) {
+    for (char* c = path + 1; *c != '\0'; c++) {
+        if (*c != '/' && *c != '\\') { continue; }
+
+        char sep = *c;
+        *c = '\0';
+        make_dir(path);
+        *c = sep;
+    }
+}
+
+b32 archive_create(
+    mem_arena* arena, frame_options* opts, char** filenames, u32 num_files,
+    const char* archive_name, archive_stats* stats
+) {
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    file_map* maps = PUSH_ARRAY(arena, file_map, num_files);
+    u8** inputs = PUSH_ARRAY(arena, u8*, num_files);
+    u64* sizes = PUSH_ARRAY(arena, u64, num_files);
+    char** names = PUSH_ARRAY(arena, char*, num_files);
+
+    u64 raw_size = 0;
+    u64 num_segments = 0;
+    u64 names_size = 0;
+    b32 ok = true;
+
+    for (u32 f = 0; f < num_files && ok; f++) {
+        names[f] = filenames[f];
+        while (names[f][0] == '.' && (names[f][1] == '/' || names[f][1] == '\\')) { names[f] += 2; }
+
+        ok = safe_name(names[f], strlen(names[f])) && load_input(arena, filenames[f], &maps[f], &inputs[f], &sizes[f]);
+
+        raw_size += sizes[f];
+        num_segments += (sizes[f] + ARCHIVE_SEGMENT_SIZE - 1) / ARCHIVE_SEGMENT_SIZE;
+        names_size += strlen(names[f]);
+    }
+
+    // Chunk lists and the unique data grow with the input, they get an
+    // arena of their own that reserves for the worst case: 16 bytes of
+    // refs, sizes and data pointers per chunk and the unique bytes
+    u64 max_chunks = num_segments * ARCHIVE_SEGMENT_CHUNKS;
+    mem_arena* data = ok ? arena_create(raw_size + max_chunks * 16 + MiB(64), MiB(16)) : NULL;
+    ok = ok && data != NULL;
+
+    archive_file* files = ok ? PUSH_ARRAY(arena, archive_file, num_files) : NULL;
+    u32* refs = ok ? PUSH_ARRAY_NZ(data, u32, max_chunks) : NULL;
+    u32* unique_sizes = ok ? PUSH_ARRAY_NZ(data, u32, max_chunks) : NULL;
+    u8** unique_data = ok ? PUSH_ARRAY_NZ(data, u8*, max_chunks) : NULL;
+    u64 num_refs = 0;
+    u64 num_unique = 0;
+    u64 unique_size = 0;
+
+    // The table gets an arena of its own. It doubles while it is below
+    // 2 * max_chunks entries and leaves the old copies behind, together
+    // they stay below twice the last one.
+    u64 table_entries = ARCHIVE_DEDUPE_MIN_ENTRIES;
+    while (table_entries < 2 * max_chunks) { table_entries *= 2; }
+
+    mem_arena* table_arena = ok ? arena_create(2 * table_entries * sizeof(dedupe_entry) + MiB(1), MiB(1)) : NULL;
+    ok = ok && table_arena != NULL;
+
+    dedupe_table table = {
+        .entries = ok ? PUSH_ARRAY(table_arena, dedupe_entry, ARCHIVE_DEDUPE_MIN_ENTRIES) : NULL,
+        .mask = ARCHIVE_DEDUPE_MIN_ENTRIES - 1
+    };
+
+    u64 batch_size = (u64)thread_pool_size(opts->pool) * ARCHIVE_BATCH_PER_THREAD;
+    archive_segment* segments = PUSH_ARRAY(arena, archive_segment, batch_size);
+    archive_chunk* chunks = PUSH_ARRAY_NZ(arena, archive_chunk, batch_size * ARCHIVE_SEGMENT_CHUNKS);
+
+    u64 gear[256];
+    gear_table_init(gear, 0x48554641);
+
+    chunk_job job = { .segments = segments, .chunks = chunks, .gear = gear };
+
+    u32 file = 0;
+    u64 file_offset = 0;
+
+    while (ok) {
+        u64 count = 0;
+        while (count < batch_size && file < num_files) {
+            if (file_offset == sizes[file]) {
+                file++;
+                file_offset = 0;
+                continue;
+            }
+
+            segments[count].data = inputs[file] + file_offset;
+            segments[count].size = MIN(ARCHIVE_SEGMENT_SIZE, sizes[file] - file_offset);
+            segments[count].file = file;
+            file_offset += segments[count].size;
+            count++;
+        }
+
+        if (count == 0) { break; }
+
+        thread_pool_run(opts->pool, chunk_segment_task, &job, count);
+
+        // Shared in input order, so the first copy of a chunk is the one
+        // kept and the frame follows the input where nothing repeats
+        for (u64 s = 0; s < count && ok; s++) {
+            archive_chunk* seg_chunks = chunks + s * ARCHIVE_SEGMENT_CHUNKS;
+            files[segments[s].file].num_refs += segments[s].num_chunks;
+
+            for (u64 i = 0; i < segments[s].num_chunks && ok; i++) {
+                archive_chunk* c = &seg_chunks[i];
+                dedupe_entry* e = dedupe_slot(&table, c->hash);
+
+                if (e->used && unique_sizes[e->unique] == c->size &&
+                    memcmp(unique_data[e->unique], c->data, c->size) == 0) {
+                    refs[num_refs++] = e->unique;
+                    continue;
+                }
+
+                unique_sizes[num_unique] = (u32)c->size;
+                unique_data[num_unique] = c->data;
+                unique_size += c->size;
+
+                if (!e->used) {
+                    e->used = true;
+                    e->hash[0] = c->hash[0];
+                    e->hash[1] = c->hash[1];
+                    e->unique = (u32)num_unique;
+
+                    if (++table.count * 2 > table.mask + 1) { ok = dedupe_grow(table_arena, &table); }
+                }
+
+                refs[num_refs++] = (u32)num_unique++;
+            }
+        }
+    }
+
+    // The manifest goes first and the frame straight after it, coded
+    // from the unique chunks gathered back to back
+    u64 manifest_size = sizeof(archive_header) + num_files * sizeof(archive_file) + names_size +
+        num_unique * sizeof(u32) + num_refs * sizeof(u32);
+
+    u8* unique = ok ? PUSH_ARRAY_NZ(data, u8, unique_size) : NULL;
+    ok = ok && unique != NULL;
+
+    u8* cursor = unique;
+    for (u64 i = 0; i < num_unique && ok; i++) {
+        memcpy(cursor, unique_data[i], unique_sizes[i]);
+        cursor += unique_sizes[i];
+    }
+
+    file_map out;
+    ok = ok && file_map_create(&out, archive_name, manifest_size + frame_bound(unique_size, opts->block_size));
+
+    u64 archive_size = 0;
+    if (ok) {
+        archive_header* header = (archive_header*)out.data;
+        header->magic = ARCHIVE_MAGIC;
+        header->version = ARCHIVE_VERSION;
+        header->reserved = 0;
+        header->num_files = num_files;
+        header->names_size = (u32)names_size;
+        header->num_unique = num_unique;
+        header->num_refs = num_refs;
+        cursor = out.data + sizeof(archive_header);
+
+        u32 name_offset = 0;
+        for (u32 f = 0; f < num_files; f++) {
+            files[f].raw_size = sizes[f];
+            files[f].name_offset = name_offset;
+            files[f].name_size = (u32)strlen(names[f]);
+            name_offset += files[f].name_size;
+        }
+
+        memcpy(cursor, files, num_files * sizeof(archive_file));
+        cursor += num_files * sizeof(archive_file);
+
+        for (u32 f = 0; f < num_files; f++) {
+            memcpy(cursor, names[f], files[f].name_size);
+            cursor += files[f].name_size;
+        }
+
+        memcpy(cursor, unique_sizes, num_unique * sizeof(u32));
+        cursor += num_unique * sizeof(u32);
+        memcpy(cursor, refs, num_refs * sizeof(u32));
+        cursor += num_refs * sizeof(u32);
+
+        archive_size = manifest_size + frame_compress(arena, opts, unique, unique_size, cursor);
+        ok = file_map_close(&out, archive_size);
+    }
+
+    for (u32 f = 0; f < num_files; f++) { file_map_close(&maps[f], 0); }
+    if (table_arena != NULL) { arena_destroy(table_arena); }
+    if (data != NULL) { arena_destroy(data); }
+
+    if (stats != NULL) {
+        stats->num_files = num_files;
+        stats->raw_size = raw_size;
+        stats->num_chunks = num_refs;
+        stats->num_unique = num_unique;
+        stats->unique_size = unique_size;
+        stats->archive_size = archive_size;
+    }
+
+    arena_temp_end(temp);
+
+    return ok;
+}
+
+b32 archive_extract(
+    mem_arena* arena, frame_options* opts, const char* archive_name,
+    const char* out_dir, archive_stats* stats
+) {
+    file_map map;
+    if (!file_map_open(&map, archive_name)) { return false; }
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    u8* in = map.data;
+    u64 size = map.size;
+    archive_header* header = (archive_header*)in;
+
+    // Every count is checked against the archive size before it is
+    // multiplied, so the manifest size cannot overflow
+    b32 ok = size >= sizeof(archive_header) &&
+        header->magic == ARCHIVE_MAGIC && header->version == ARCHIVE_VERSION &&
+        header->num_files <= size / sizeof(archive_file) &&
+        header->num_unique <= size / sizeof(u32) && header->num_refs <= size / sizeof(u32);
+
+    u64 manifest_size = ok ? sizeof(archive_header) + (u64)header->num_files * sizeof(archive_file) +
+        header->names_size + (header->num_unique + header->num_refs) * sizeof(u32) : 0;
+    ok = ok && manifest_size <= size;
+
+    archive_file* files = (archive_file*)(in + sizeof(archive_header));
+    char* names = (char*)(files + (ok ? header->num_files : 0));
+    u32* unique_sizes = (u32*)(names + (ok ? header->names_size : 0));
+    u32* refs = unique_sizes + (ok ? header->num_unique : 0);
+
+    u64 num_unique = ok ? header->num_unique : 0;
+    u64 num_refs = ok ? header->num_refs : 0;
+    u64 unique_size = 0;
+    for (u64 i = 0; i < num_unique; i++) { unique_size += unique_sizes[i]; }
+
+    u8* frame = in + manifest_size;
+    u64 frame_size = size - manifest_size;
+    ok = ok && frame_raw_size(frame, frame_size) == unique_size;
+
+    mem_arena* data = ok ? arena_create(unique_size + num_unique * sizeof(u64) + MiB(1), MiB(16)) : NULL;
+    ok = ok && data != NULL;
+
+    u8* unique = ok ? PUSH_ARRAY_NZ(data, u8, unique_size) : NULL;
+    u64* offsets = ok ? PUSH_ARRAY_NZ(data, u64, num_unique) : NULL;
+    ok = ok && frame_decompress(arena, opts, frame, frame_size, unique, unique_size);
+
+    u64 offset = 0;
+    for (u64 i = 0; i < num_unique && ok; i++) {
+        offsets[i] = offset;
+        offset += unique_sizes[i];
+    }
+
+    u64 dir_size = strlen(out_dir);
+    if (ok) { make_dir(out_dir); }
+
+    u64 ref = 0;
+    for (u32 f = 0; f < (ok ? header->num_files : 0) && ok; f++) {
+        archive_file* af = &files[f];
+        char* name = names + af->name_offset;
+
+        ok = (u64)af->name_offset + af->name_size <= header->names_size && safe_name(name, af->name_size) &&
+            af->num_refs <= num_refs - ref;
+        if (!ok) { break; }
+
+        // Every chunk of the file has to exist and add up to its size
+        u64 total = 0;
+        for (u64 i = 0; i < af->num_refs && ok; i++) {
+            ok = refs[ref + i] < num_unique;
+            if (ok) { total += unique_sizes[refs[ref + i]]; }
+        }
+        ok = ok && total == af->raw_size;
+        if (!ok) { break; }
+
+        char* path = PUSH_ARRAY(arena, char, dir_size + 1 + af->name_size + 1);
+        memcpy(path, out_dir, dir_size);
+        path[dir_size] = '/';
+        memcpy(path + dir_size + 1, name, af->name_size);
+        make_parent_dirs(path);
+
+        file_map out;
+        ok = file_map_create(&out, path, af->raw_size);
+
+        u8* cursor = out.data;
+        for (u64 i = 0; i < af->num_refs && ok; i++) {
+            u32 c = refs[ref + i];
+            memcpy(cursor, unique + offsets[c], unique_sizes[c]);
+            cursor += unique_sizes[c];
+        }
+
+        ok = ok && file_map_close(&out, af->raw_size);
+        ref += af->num_refs;
+    }
+
+    ok = ok && ref == num_refs;
+
+    if (stats != NULL) {
+        stats->num_files = ok ? header->num_files : 0;
+        stats->raw_size = 0;
+        for (u32 f = 0; f < stats->num_files; f++) { stats->raw_size += files[f].raw_size; }
+        stats->num_chunks = num_refs;
+        stats->num_unique = num_unique;
+        stats->unique_size = unique_size;
+        stats->archive_size = size;
+    }
+
+    if (data != NULL) { arena_destroy(data); }
+    file_map_close(&map, 0);
+
+    arena_temp_end(temp);
+
+    return ok;
+}
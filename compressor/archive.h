@@ -0,0 +1,72 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "base.h"
+#include "arena.h"
+#include "frame.h"
+
+// Archives store content shared between files once. Every input is cut
+// into chunks where a gear hash of the last 64 bytes has its top bits
+// clear, so boundaries follow the content and an insertion only moves
+// the ones next to it. Chunks with the same hash and bytes are kept
+// once, the unique ones are concatenated and coded as a single frame,
+// and a manifest lists the chunks that make up each file:
+//
+//   archive_header
+//   archive_file per file, then the names back to back
+//   u32 size per unique chunk, in the order they appear in the frame
+//   u32 unique chunk index per chunk of every file, files in order
+//   frame of the unique chunks, up to the end of the archive
+//
+// Inputs are cut in segments of ARCHIVE_SEGMENT_SIZE that are chunked and
+// hashed in parallel. A segment start always ends a chunk, which costs
+// about one chunk of matching per segment when content moves.
+
+#define ARCHIVE_MAGIC 0x41465548 // Hex for "HUFA"
+#define ARCHIVE_VERSION 1
+
+#define ARCHIVE_MIN_CHUNK KiB(2)
+#define ARCHIVE_CHUNK_BITS 13 // Chunks average about 2^13 bytes past the minimum
+#define ARCHIVE_MAX_CHUNK KiB(64)
+#define ARCHIVE_SEGMENT_SIZE MiB(4)
+
+#pragma pack(push, 1)
+typedef struct {
+    u32 magic;
+    u16 version;
+    u16 reserved;
+    u32 num_files;
+    u32 names_size;
+    u64 num_unique;
+    u64 num_refs;
+} archive_header;
+
+typedef struct {
+    u64 raw_size;
+    u64 num_refs;
+    u32 name_offset;
+    u32 name_size;
+} archive_file;
+#pragma pack(pop)
+
+typedef struct {
+    u64 num_files;
+    u64 raw_size;
+    u64 num_chunks;
+    u64 num_unique;
+    u64 unique_size;
+    u64 archive_size;
+} archive_stats;
+
+// Names are stored as given and must be relative without "..", extraction
+// recreates them below out_dir
+b32 archive_create(
+    mem_arena* arena, frame_options* opts, char** filenames, u32 num_files,
+    const char* archive_name, archive_stats* stats
+);
+b32 archive_extract(
+    mem_arena* arena, frame_options* opts, const char* archive_name,
+    const char* out_dir, archive_stats* stats
+);
+
+#endif
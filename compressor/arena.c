@@ -18,6 +18,7 @@ mem_arena* arena_create(u64 reserve_size, u64 commit_size) {
     arena->commit_size = commit_size;
     arena->pos = ARENA_BASE_POS;
     arena->commit_pos = commit_size;
+    arena->peak_pos = ARENA_BASE_POS;
     
     return arena;
 }
@@ -49,6 +50,7 @@ void* arena_push(mem_arena* arena, u64 size, b32 non_zero) {
     }
 
     arena->pos = new_pos;
+    arena->peak_pos = MAX(arena->peak_pos, new_pos);
 
     u8* out = (u8*)arena + pos_aligned;
 
@@ -12,6 +12,7 @@ typedef struct {
 
     u64 pos;
     u64 commit_pos;
+    u64 peak_pos; // Highest pos so far, temps and pops leave it alone
 } mem_arena;
 
 typedef struct {
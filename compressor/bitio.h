@@ -0,0 +1,113 @@
+#ifndef BITIO_H
+#define BITIO_H
+
+#include <string.h>
+
+#include "base.h"
+
+// Bits are stored MSB first within each byte, matching the original
+// one-bit-at-a-time writer, so every format decodes with the same reader.
+
+typedef struct {
+    u8* data;
+    u8* cursor;
+
+    u64 bits; // Right aligned, only the low bit_count bits are pending
+    u32 bit_count;
+} bit_writer;
+
+typedef struct {
+    u8* data;
+    u64 size;
+    u64 bit_pos;
+
+    u64 bits; // Left aligned, the next bit to read is bit 63
+    u32 bit_count;
+} bit_reader;
+
+static inline u64 load_be64(const u8* p) {
+    u64 v;
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap64(v);
+}
+
+static inline void store_be64(u8* p, u64 v) {
+    v = __builtin_bswap64(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+// The writer always stores a whole word, so the destination needs 8 bytes
+// of slack past the last byte that is actually used.
+static inline void bit_writer_init(bit_writer* bw, u8* data) {
+    bw->data = data;
+    bw->cursor = data;
+    bw->bits = 0;
+    bw->bit_count = 0;
+}
+
+// At most 56 bits may be put between flushes
+static inline void bit_writer_put(bit_writer* bw, u32 code, u32 len) {
+    bw->bits = (bw->bits << len) | code;
+    bw->bit_count += len;
+}
+
+static inline void bit_writer_flush(bit_writer* bw) {
+    store_be64(bw->cursor, (bw->bits << (63 - bw->bit_count)) << 1);
+    bw->cursor += bw->bit_count >> 3;
+    bw->bit_count &= 7;
+}
+
+// Returns the number of bytes written, including a final partial byte
+static inline u64 bit_writer_finish(bit_writer* bw) {
+    bit_writer_flush(bw);
+    return (u64)(bw->cursor - bw->data) + (bw->bit_count > 0 ? 1 : 0);
+}
+
+static inline void bit_reader_init(bit_reader* br, u8* data, u64 size) {
+    br->data = data;
+    br->size = size;
+    br->bit_pos = 0;
+    br->bits = 0;
+    br->bit_count = 0;
+}
+
+// Leaves at least 57 valid bits in the window. Past the end of the data
+// the window is padded with zeros instead of reading out of bounds.
+static inline void bit_reader_refill(bit_reader* br) {
+    u64 byte_idx = br->bit_pos >> 3;
+    u64 word;
+
+    if (byte_idx + 8 <= br->size) {
+        word = load_be64(br->data + byte_idx);
+    } else {
+        u8 tail[8] = {0};
+        if (byte_idx < br->size) {
+            memcpy(tail, br->data + byte_idx, br->size - byte_idx);
+        }
+        word = load_be64(tail);
+    }
+
+    u32 skip = (u32)(br->bit_pos & 7);
+    br->bits = word << skip;
+    br->bit_count = 64 - skip;
+}
+
+static inline u32 bit_reader_peek(bit_reader* br, u32 n) {
+    return (u32)(br->bits >> (64 - n));
+}
+
+static inline void bit_reader_consume(bit_reader* br, u32 n) {
+    br->bits <<= n;
+    br->bit_count -= n;
+    br->bit_pos += n;
+}
+
+static inline u32 bit_reader_read(bit_reader* br, u32 n) {
+    if (br->bit_count < n) { bit_reader_refill(br); }
+
+    u32 v = bit_reader_peek(br, n);
+    bit_reader_consume(br, n);
+    return v;
+}
+
+#endif
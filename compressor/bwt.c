@@ -0,0 +1,370 @@
+#include <string.h>
+
+#include "bwt.h"
+#include "huffman.h"
+#include "histogram.h"
+
+// Move-to-front ranks are shifted up by one to make room for the two run
+// digits, the two largest ranks no longer fit a byte and are escaped
+#define BWT_RUN_A 0
+#define BWT_RUN_B 1
+#define BWT_ESCAPE 255
+#define BWT_MAX_DIRECT_RANK 253
+
+#define BWT_PACKED_ROWS (1u << 24)
+
+#define SAIS_IS_LMS(t, i) ((i) > 0 && (t)[i] && !(t)[(i) - 1])
+
+// Start (or end, one past the last slot) of every symbol's bucket
+static void sais_buckets(i32* counts, i32* bkt, i32 k, b32 end) {
+    i32 sum = 0;
+    for (i32 c = 0; c < k; c++) {
+        sum += counts[c];
+        bkt[c] = end ? sum : sum - counts[c];
+    }
+}
+
+// Sorted LMS suffixes in place induce the L-type suffixes left to right,
+// those then induce the S-type suffixes right to left
+static void sais_induce(i32* s, u8* t, i32* sa, i32* counts, i32* bkt, i32 n, i32 k) {
+    sais_buckets(counts, bkt, k, false);
+    for (i32 i = 0; i < n; i++) {
+        i32 j = sa[i] - 1;
+        if (j >= 0 && !t[j]) { sa[bkt[s[j]]++] = j; }
+    }
+
+    sais_buckets(counts, bkt, k, true);
+    for (i32 i = n - 1; i >= 0; i--) {
+        i32 j = sa[i] - 1;
+        if (j >= 0 && t[j]) { sa[--bkt[s[j]]] = j; }
+    }
+}
+
+// SA-IS (Nong, Zhang and Chan). s ends with a unique sentinel 0 and
+// every symbol is below k. Sorting the LMS substrings (an S-type suffix
+// after an L-type one) by induction names them, if two names are equal
+// the names are sorted recursively, and the sorted LMS suffixes then
+// induce the whole array. The reduced string and its suffix array share
+// sa with the result, only the types and buckets take extra memory.
+static void sais(mem_arena* arena, i32* s, i32* sa, i32 n, i32 k) {
+    if (n == 1) {
+        sa[0] = 0;
+        return;
+    }
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    // t[i] is set for S-type suffixes, smaller than the one after them
+    u8* t = PUSH_ARRAY_NZ(arena, u8, n);
+    i32* counts = PUSH_ARRAY(arena, i32, k);
+    i32* bkt = PUSH_ARRAY_NZ(arena, i32, k);
+    for (i32 i = 0; i < n; i++) { counts[s[i]]++; }
+
+    t[n - 1] = 1;
+    t[n - 2] = 0;
+    for (i32 i = n - 3; i >= 0; i--) {
+        t[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && t[i + 1]);
+    }
+
+    sais_buckets(counts, bkt, k, true);
+    for (i32 i = 0; i < n; i++) { sa[i] = -1; }
+    for (i32 i = 1; i < n; i++) {
+        if (SAIS_IS_LMS(t, i)) { sa[--bkt[s[i]]] = i; }
+    }
+    sais_induce(s, t, sa, counts, bkt, n, k);
+
+    i32 n1 = 0;
+    for (i32 i = 0; i < n; i++) {
+        if (SAIS_IS_LMS(t, sa[i])) { sa[n1++] = sa[i]; }
+    }
+
+    // LMS positions are at least two apart, so pos / 2 gives each its own
+    // slot in the upper half
+    for (i32 i = n1; i < n; i++) { sa[i] = -1; }
+
+    i32 name = 0;
+    i32 prev = -1;
+    for (i32 i = 0; i < n1; i++) {
+        i32 pos = sa[i];
+        b32 diff = false;
+
+        for (i32 d = 0; d < n; d++) {
+            if (prev == -1 || s[pos + d] != s[prev + d] || t[pos + d] != t[prev + d]) {
+                diff = true;
+                break;
+            }
+            if (d > 0 && (SAIS_IS_LMS(t, pos + d) || SAIS_IS_LMS(t, prev + d))) { break; }
+        }
+
+        if (diff) {
+            name++;
+            prev = pos;
+        }
+        sa[n1 + pos / 2] = name - 1;
+    }
+
+    for (i32 i = n - 1, j = n - 1; i >= n1; i--) {
+        if (sa[i] >= 0) { sa[j--] = sa[i]; }
+    }
+
+    i32* sa1 = sa;
+    i32* s1 = sa + n - n1;
+    if (name < n1) {
+        sais(arena, s1, sa1, n1, name);
+    } else {
+        for (i32 i = 0; i < n1; i++) { sa1[s1[i]] = i; }
+    }
+
+    sais_buckets(counts, bkt, k, true);
+    for (i32 i = 1, j = 0; i < n; i++) {
+        if (SAIS_IS_LMS(t, i)) { s1[j++] = i; }
+    }
+    for (i32 i = 0; i < n1; i++) { sa1[i] = s1[sa1[i]]; }
+    for (i32 i = n1; i < n; i++) { sa[i] = -1; }
+
+    for (i32 i = n1 - 1; i >= 0; i--) {
+        i32 j = sa[i];
+        sa[i] = -1;
+        sa[--bkt[s[j]]] = j;
+    }
+    sais_induce(s, t, sa, counts, bkt, n, k);
+
+    arena_temp_end(temp);
+}
+
+// The block gets a sentinel smaller than every byte, so its rotations sort
+// like its suffixes. The sentinel's own row is left out of last and its
+// position returned, the first row (the sentinel suffix) is never it.
+static u32 bwt_forward(mem_arena* arena, u8* in, u64 size, u8* last) {
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    i32 n = (i32)size + 1;
+    i32* s = PUSH_ARRAY_NZ(arena, i32, n);
+    i32* sa = PUSH_ARRAY_NZ(arena, i32, n);
+
+    for (u64 i = 0; i < size; i++) { s[i] = in[i] + 1; }
+    s[size] = 0;
+
+    sais(arena, s, sa, n, 257);
+
+    u32 primary = 0;
+    u64 j = 0;
+    for (i32 i = 0; i < n; i++) {
+        if (sa[i] == 0) {
+            primary = (u32)i;
+        } else {
+            last[j++] = in[sa[i] - 1];
+        }
+    }
+
+    arena_temp_end(temp);
+
+    return primary;
+}
+
+// Walks the rows from the sentinel suffix backwards through the text.
+// lf maps a row to the row of the suffix one byte longer. Rows of blocks
+// under 16M carry their byte in the low 8 bits, so each step is a single
+// dependent load.
+static b32 bwt_inverse(mem_arena* arena, u8* last, u64 size, u64 primary, u8* out) {
+    if (primary == 0 || primary > size) { return false; }
+
+    u32 counts[256] = { 0 };
+    for (u64 i = 0; i < size; i++) { counts[last[i]]++; }
+
+    // Row 0 belongs to the sentinel
+    u32 next[256];
+    u32 sum = 1;
+    for (u32 c = 0; c < 256; c++) {
+        next[c] = sum;
+        sum += counts[c];
+    }
+
+    u32* lf = PUSH_ARRAY_NZ(arena, u32, size + 1);
+
+    if (size < BWT_PACKED_ROWS) {
+        for (u64 row = 0; row <= size; row++) {
+            if (row == primary) { continue; }
+            u8 c = last[row - (row > primary)];
+            lf[row] = (next[c]++ << 8) | c;
+        }
+
+        u64 row = 0;
+        for (u64 i = size; i-- > 0;) {
+            if (row == primary) { return false; }
+            u32 entry = lf[row];
+            out[i] = (u8)entry;
+            row = entry >> 8;
+        }
+
+        return row == primary;
+    }
+
+    for (u64 row = 0; row <= size; row++) {
+        if (row == primary) { continue; }
+        lf[row] = next[last[row - (row > primary)]]++;
+    }
+
+    u64 row = 0;
+    for (u64 i = size; i-- > 0;) {
+        if (row == primary) { return false; }
+        out[i] = last[row - (row > primary)];
+        row = lf[row];
+    }
+
+    return row == primary;
+}
+
+static u8* bwt_put_run(u8* out, u64 run) {
+    run--;
+    while (1) {
+        *out++ = (run & 1) ? BWT_RUN_B : BWT_RUN_A;
+        if (run < 2) { break; }
+        run = (run - 2) / 2;
+    }
+
+    return out;
+}
+
+// out must hold 2 * size bytes, in case every rank is escaped
+static u64 bwt_mtf_encode(u8* in, u64 size, u8* out) {
+    u8 order[256];
+    for (u32 i = 0; i < 256; i++) { order[i] = (u8)i; }
+
+    u8* op = out;
+    u64 run = 0;
+
+    for (u64 i = 0; i < size; i++) {
+        u8 c = in[i];
+        if (order[0] == c) {
+            run++;
+            continue;
+        }
+
+        if (run > 0) {
+            op = bwt_put_run(op, run);
+            run = 0;
+        }
+
+        u32 rank = 1;
+        u8 carry = order[0];
+        while (order[rank] != c) {
+            u8 next = order[rank];
+            order[rank] = carry;
+            carry = next;
+            rank++;
+        }
+        order[rank] = carry;
+        order[0] = c;
+
+        if (rank <= BWT_MAX_DIRECT_RANK) {
+            *op++ = (u8)(rank + 1);
+        } else {
+            *op++ = BWT_ESCAPE;
+            *op++ = (u8)(rank - BWT_MAX_DIRECT_RANK - 1);
+        }
+    }
+
+    if (run > 0) { op = bwt_put_run(op, run); }
+
+    return (u64)(op - out);
+}
+
+static b32 bwt_mtf_decode(u8* in, u64 in_size, u8* out, u64 out_size) {
+    u8 order[256];
+    for (u32 i = 0; i < 256; i++) { order[i] = (u8)i; }
+
+    u8* op = out;
+    u8* end = out + out_size;
+    u64 run = 0;
+    u64 weight = 1;
+
+    for (u64 i = 0; i < in_size; i++) {
+        u8 symbol = in[i];
+
+        if (symbol <= BWT_RUN_B) {
+            run += weight << symbol;
+            weight <<= 1;
+            if (run > (u64)(end - op)) { return false; }
+            continue;
+        }
+
+        if (run > 0) {
+            memset(op, order[0], run);
+            op += run;
+            run = 0;
+            weight = 1;
+        }
+
+        u32 rank = symbol - 1u;
+        if (symbol == BWT_ESCAPE) {
+            if (++i == in_size || in[i] > 255 - BWT_MAX_DIRECT_RANK - 1) { return false; }
+            rank = BWT_MAX_DIRECT_RANK + 1 + in[i];
+        }
+
+        if (op == end) { return false; }
+
+        u8 c = order[rank];
+        memmove(order + 1, order, rank);
+        order[0] = c;
+        *op++ = c;
+    }
+
+    memset(op, order[0], run);
+    op += run;
+
+    return op == end;
+}
+
+u64 bwt_compress_block(mem_arena* arena, u8* in, u64 size, u8* out, u64 capacity) {
+    if (size == 0 || capacity < 2 * sizeof(u32)) { return 0; }
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    u8* last = PUSH_ARRAY_NZ(arena, u8, size);
+    u32 primary = bwt_forward(arena, in, size, last);
+
+    u8* symbols = PUSH_ARRAY_NZ(arena, u8, 2 * size);
+    u64 num_symbols = bwt_mtf_encode(last, size, symbols);
+
+    u32 counts[HUFF_SYMBOLS];
+    hist_count(symbols, num_symbols, counts);
+
+    // Straight into out when the worst case fits
+    u64 bound = HUFF_BLOCK_BOUND(num_symbols);
+    u8* coded = bound <= capacity - 2 * sizeof(u32) ? out + 2 * sizeof(u32) : PUSH_ARRAY_NZ(arena, u8, bound);
+    u64 coded_size = huff_compress_block(arena, symbols, num_symbols, counts, coded, NULL);
+
+    u64 comp_size = 0;
+    if (coded_size <= capacity - 2 * sizeof(u32)) {
+        *(u32*)out = primary;
+        *(u32*)(out + 4) = (u32)num_symbols;
+        if (coded != out + 2 * sizeof(u32)) { memcpy(out + 2 * sizeof(u32), coded, coded_size); }
+        comp_size = 2 * sizeof(u32) + coded_size;
+    }
+
+    arena_temp_end(temp);
+
+    return comp_size;
+}
+
+b32 bwt_decompress_block(mem_arena* arena, u8* in, u64 in_size, u8* out, u64 out_size) {
+    if (in_size < 2 * sizeof(u32) || out_size == 0) { return false; }
+
+    u64 primary = *(u32*)in;
+    u64 num_symbols = *(u32*)(in + 4);
+    if (num_symbols == 0 || num_symbols > 2 * out_size) { return false; }
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    u8* symbols = PUSH_ARRAY_NZ(arena, u8, num_symbols);
+    u8* last = PUSH_ARRAY_NZ(arena, u8, out_size);
+
+    b32 ok = huff_decompress_block(arena, in + 2 * sizeof(u32), in_size - 2 * sizeof(u32), symbols, num_symbols) &&
+        bwt_mtf_decode(symbols, num_symbols, last, out_size) &&
+        bwt_inverse(arena, last, out_size, primary, out);
+
+    arena_temp_end(temp);
+
+    return ok;
+}
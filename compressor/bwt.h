@@ -0,0 +1,22 @@
+#ifndef BWT_H
+#define BWT_H
+
+#include "base.h"
+#include "arena.h"
+
+// Burrows-Wheeler block coder in the style of bzip2, for text where ratio
+// matters more than speed. Sorting the block by its suffixes groups every
+// byte with the others that precede the same context, move-to-front turns
+// those groups into mostly small ranks, runs of rank zero are coded in
+// bijective base 2 and the result goes through the Huffman coder.
+//
+//   u32 sentinel row | u32 number of symbols | Huffman block
+//
+// The suffix array is built with SA-IS in linear time, it takes 8 bytes
+// of arena per input byte while the block is sorted.
+
+// Returns 0 if the block does not fit capacity bytes
+u64 bwt_compress_block(mem_arena* arena, u8* in, u64 size, u8* out, u64 capacity);
+b32 bwt_decompress_block(mem_arena* arena, u8* in, u64 in_size, u8* out, u64 out_size);
+
+#endif
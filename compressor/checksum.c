@@ -0,0 +1,98 @@
+#include <string.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+#include "checksum.h"
+
+#define CRC32C_POLY 0x82F63B78 // Reflected
+
+// Below this many bytes per lane splitting is not worth the combine
+#define CRC32C_MIN_LANE KiB(4)
+
+// a * b modulo the polynomial, both in reflected form where bit 31 is x^0
+static u32 crc32c_multiply(u32 a, u32 b) {
+    u32 product = 0;
+
+    for (u32 m = 1u << 31; m != 0; m >>= 1) {
+        if (a & m) { product ^= b; }
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+
+    return product;
+}
+
+// The checksum of A followed by B from the checksums of both. Appending
+// len_b bytes multiplies the state of A by x^(8 * len_b).
+static u32 crc32c_combine(u32 crc_a, u32 crc_b, u64 len_b) {
+    u32 shift = 1u << 31; // x^0
+    u32 square = 1u << 30; // x^1, squared up to x^(2^k) as k goes up
+
+    for (u64 n = len_b * 8; n != 0; n >>= 1) {
+        if (n & 1) { shift = crc32c_multiply(square, shift); }
+        square = crc32c_multiply(square, square);
+    }
+
+    return crc32c_multiply(shift, crc_a) ^ crc_b;
+}
+
+static u32 crc32c_serial(u32 state, u8* data, u64 size) {
+    u64 i = 0;
+
+#if defined(__SSE4_2__)
+    u64 c = state;
+    for (; i + 8 <= size; i += 8) {
+        u64 v;
+        memcpy(&v, data + i, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+    }
+    state = (u32)c;
+
+    for (; i < size; i++) { state = _mm_crc32_u8(state, data[i]); }
+#else
+    for (; i < size; i++) {
+        state ^= data[i];
+        for (u32 b = 0; b < 8; b++) {
+            state = (state >> 1) ^ (CRC32C_POLY & (0u - (state & 1)));
+        }
+    }
+#endif
+
+    return state;
+}
+
+// The crc32 instruction takes 3 cycles but a new one can start every
+// cycle, so large inputs run as three independent lanes that are
+// combined at the end
+u32 crc32c(u32 crc, u8* data, u64 size) {
+#if defined(__SSE4_2__)
+    if (size >= 3 * CRC32C_MIN_LANE) {
+        u64 lane = (size / 3) & ~(u64)7;
+        u8* p0 = data;
+        u8* p1 = data + lane;
+        u8* p2 = data + 2 * lane;
+
+        u64 c0 = ~crc;
+        u64 c1 = 0xFFFFFFFF;
+        u64 c2 = 0xFFFFFFFF;
+
+        for (u64 i = 0; i < lane; i += 8) {
+            u64 v0, v1, v2;
+            memcpy(&v0, p0 + i, sizeof(v0));
+            memcpy(&v1, p1 + i, sizeof(v1));
+            memcpy(&v2, p2 + i, sizeof(v2));
+            c0 = _mm_crc32_u64(c0, v0);
+            c1 = _mm_crc32_u64(c1, v1);
+            c2 = _mm_crc32_u64(c2, v2);
+        }
+
+        crc = crc32c_combine(~(u32)c0, ~(u32)c1, lane);
+        crc = crc32c_combine(crc, ~(u32)c2, lane);
+
+        return ~crc32c_serial(~crc, data + 3 * lane, size - 3 * lane);
+    }
+#endif
+
+    return ~crc32c_serial(~crc, data, size);
+}
@@ -0,0 +1,10 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include "base.h"
+
+// CRC32C (Castagnoli), as used by iSCSI and ext4. Pass the result of the
+// previous call to continue a checksum, 0 to start one.
+u32 crc32c(u32 crc, u8* data, u64 size);
+
+#endif
@@ -0,0 +1,233 @@
+#include <string.h>
+
+#include "cm.h"
+
+#define CM_INPUTS 4 // Order 0, 1 and 2 plus a bias
+#define CM_COUNT_LIMIT 30
+#define CM_LEARNING_RATE 2
+
+// Counters hold the probability of a 1 in the top 22 bits and how often
+// they were updated in the low 10. New counters adapt quickly, the rate
+// then drops as 1 / count down to 1 / CM_COUNT_LIMIT.
+#define CM_COUNTER_INIT (1u << 31)
+
+typedef struct {
+    u32 order0[256];
+    u32 order1[256 * 256];
+    u32* order2;
+
+    // One weight set per partial byte, in 16.16 fixed point
+    i32 weights[256][CM_INPUTS];
+
+    i16 stretch[4096];
+    u32 rates[1024];
+
+    // Contexts of the byte being coded
+    u32 c0; // Bits seen so far with a leading 1
+    u32 c1; // Previous byte
+    u32 order2_base;
+
+    u32* counters[CM_INPUTS - 1];
+    i32 inputs[CM_INPUTS];
+    i32 prediction;
+} cm_model;
+
+// Carryless binary arithmetic coder over [low, high]. Once the top bytes
+// of both ends agree that byte is final and shifted out.
+typedef struct {
+    u32 low;
+    u32 high;
+    u32 x; // Decoder only, the code value read so far
+
+    u8* data;
+    u64 pos;
+    u64 size;
+} cm_coder;
+
+// Logistic function, maps the stretched domain (-2047..2047) to a 12-bit
+// probability by interpolating between 33 points
+static i32 cm_squash(i32 d) {
+    static const i32 points[33] = {
+        1, 2, 3, 6, 10, 16, 27, 45, 73, 120, 194, 310, 488, 747, 1101,
+        1546, 2047, 2549, 2994, 3348, 3607, 3785, 3901, 3975, 4022,
+        4050, 4068, 4079, 4085, 4089, 4092, 4093, 4094
+    };
+
+    if (d > 2047) { return 4095; }
+    if (d < -2047) { return 1; }
+
+    i32 w = d & 127;
+    i32 i = (d >> 7) + 16;
+    return (points[i] * (128 - w) + points[i + 1] * w + 64) >> 7;
+}
+
+static cm_model* cm_model_create(mem_arena* arena) {
+    cm_model* m = PUSH_STRUCT_NZ(arena, cm_model);
+    m->order2 = PUSH_ARRAY_NZ(arena, u32, 1u << CM_ORDER2_BITS);
+
+    for (u32 i = 0; i < 256; i++) { m->order0[i] = CM_COUNTER_INIT; }
+    for (u32 i = 0; i < 256 * 256; i++) { m->order1[i] = CM_COUNTER_INIT; }
+    for (u32 i = 0; i < (1u << CM_ORDER2_BITS); i++) { m->order2[i] = CM_COUNTER_INIT; }
+
+    for (u32 i = 0; i < 256; i++) {
+        for (u32 j = 0; j < CM_INPUTS - 1; j++) { m->weights[i][j] = (1 << 16) / 3; }
+        m->weights[i][CM_INPUTS - 1] = 0;
+    }
+
+    // The inverse of cm_squash
+    i32 next = 0;
+    for (i32 d = -2047; d <= 2047; d++) {
+        i32 v = cm_squash(d);
+        for (i32 p = next; p <= v; p++) { m->stretch[p] = (i16)d; }
+        next = v + 1;
+    }
+    for (i32 p = next; p < 4096; p++) { m->stretch[p] = 2047; }
+
+    for (u32 i = 0; i < 1024; i++) { m->rates[i] = (1u << 17) / (2 * i + 3); }
+
+    m->c0 = 1;
+    m->c1 = 0;
+    m->order2_base = 0;
+
+    return m;
+}
+
+static inline i32 cm_predict(cm_model* m) {
+    m->counters[0] = &m->order0[m->c0];
+    m->counters[1] = &m->order1[(m->c1 << 8) | m->c0];
+    m->counters[2] = &m->order2[m->order2_base | m->c0];
+
+    i32* w = m->weights[m->c0];
+    i64 dot = 0;
+
+    for (u32 i = 0; i < CM_INPUTS - 1; i++) {
+        m->inputs[i] = m->stretch[*m->counters[i] >> 20];
+        dot += (i64)m->inputs[i] * w[i];
+    }
+
+    m->inputs[CM_INPUTS - 1] = 256;
+    dot += (i64)256 * w[CM_INPUTS - 1];
+
+    m->prediction = CLAMP(cm_squash((i32)(dot >> 16)), 1, 4095);
+    return m->prediction;
+}
+
+static inline void cm_update(cm_model* m, u32 bit) {
+    i32 err = (i32)((bit << 12) - (u32)m->prediction) * CM_LEARNING_RATE;
+    i32* w = m->weights[m->c0];
+
+    for (u32 i = 0; i < CM_INPUTS; i++) {
+        w[i] += (m->inputs[i] * err) >> 10;
+    }
+
+    for (u32 i = 0; i < CM_INPUTS - 1; i++) {
+        u32 c = *m->counters[i];
+        u32 n = c & 1023;
+        i64 p = c >> 10;
+
+        p += (((i64)bit << 22) - p) * m->rates[n] >> 16;
+        *m->counters[i] = ((u32)p << 10) | (n < CM_COUNT_LIMIT ? n + 1 : n);
+    }
+
+    m->c0 = (m->c0 << 1) | bit;
+
+    if (m->c0 >= 256) {
+        u32 c2 = m->c1;
+        m->c1 = m->c0 & 255;
+        m->c0 = 1;
+
+        u32 h = ((c2 << 8) | m->c1) * 0x9E3779B1u;
+        m->order2_base = (h >> (32 - (CM_ORDER2_BITS - 8))) << 8;
+    }
+}
+
+// p is the probability of a 1 in 12 bits
+static inline b32 cm_encode(cm_coder* c, u32 bit, i32 p) {
+    u32 mid = c->low + (u32)(((u64)(c->high - c->low) * (u32)p) >> 12);
+    if (bit) { c->high = mid; } else { c->low = mid + 1; }
+
+    while (((c->low ^ c->high) & 0xFF000000) == 0) {
+        if (c->pos >= c->size) { return false; }
+
+        c->data[c->pos++] = (u8)(c->high >> 24);
+        c->low <<= 8;
+        c->high = (c->high << 8) | 255;
+    }
+
+    return true;
+}
+
+// Reads past the end return 0xFF, which is what the encoder's final byte
+// assumes follows it
+static inline u32 cm_next_byte(cm_coder* c) {
+    u64 pos = c->pos++;
+    return pos < c->size ? c->data[pos] : 255;
+}
+
+static inline u32 cm_decode(cm_coder* c, i32 p) {
+    u32 mid = c->low + (u32)(((u64)(c->high - c->low) * (u32)p) >> 12);
+    u32 bit = c->x <= mid;
+    if (bit) { c->high = mid; } else { c->low = mid + 1; }
+
+    while (((c->low ^ c->high) & 0xFF000000) == 0) {
+        c->low <<= 8;
+        c->high = (c->high << 8) | 255;
+        c->x = (c->x << 8) | cm_next_byte(c);
+    }
+
+    return bit;
+}
+
+u64 cm_compress_block(mem_arena* arena, u8* in, u64 size, u8* out, u64 capacity) {
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    cm_model* m = cm_model_create(arena);
+    cm_coder c = { .low = 0, .high = 0xFFFFFFFF, .data = out, .size = capacity };
+    b32 ok = true;
+
+    for (u64 i = 0; i < size && ok; i++) {
+        for (i32 b = 7; b >= 0; b--) {
+            u32 bit = (in[i] >> b) & 1;
+            ok = ok && cm_encode(&c, bit, cm_predict(m));
+            cm_update(m, bit);
+        }
+    }
+
+    // Any value starting with the top byte of low is inside the range,
+    // the decoder fills in the rest with ones
+    ok = ok && c.pos < capacity;
+    if (ok) { out[c.pos++] = (u8)(c.low >> 24); }
+
+    arena_temp_end(temp);
+
+    return ok ? c.pos : 0;
+}
+
+b32 cm_decompress_block(mem_arena* arena, u8* in, u64 in_size, u8* out, u64 out_size) {
+    if (in_size == 0) { return false; }
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    cm_model* m = cm_model_create(arena);
+    cm_coder c = { .low = 0, .high = 0xFFFFFFFF, .data = in, .size = in_size };
+
+    for (u32 i = 0; i < 4; i++) { c.x = (c.x << 8) | cm_next_byte(&c); }
+
+    for (u64 i = 0; i < out_size; i++) {
+        u32 byte = 0;
+
+        for (u32 b = 0; b < 8; b++) {
+            u32 bit = cm_decode(&c, cm_predict(m));
+            cm_update(m, bit);
+            byte = (byte << 1) | bit;
+        }
+
+        out[i] = (u8)byte;
+    }
+
+    arena_temp_end(temp);
+
+    // The decoder runs 3 bytes ahead of the encoder, anything else means
+    // the block was cut short or has trailing garbage
+    return c.pos == in_size + 3;
+}
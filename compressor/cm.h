@@ -0,0 +1,20 @@
+#ifndef CM_H
+#define CM_H
+
+#include "base.h"
+#include "arena.h"
+
+// Context mixing coder for when ratio matters more than speed. Every byte
+// is coded as 8 binary decisions with an adaptive arithmetic coder. The
+// probability of each bit is predicted from the bits of the byte seen so
+// far under order 0, 1 and 2 contexts, and the three predictions are
+// combined by a small online-trained logistic mixer.
+
+// The order 2 model hashes its contexts into this many counters
+#define CM_ORDER2_BITS 22
+
+// Returns 0 if the block does not fit capacity bytes
+u64 cm_compress_block(mem_arena* arena, u8* in, u64 size, u8* out, u64 capacity);
+b32 cm_decompress_block(mem_arena* arena, u8* in, u64 in_size, u8* out, u64 out_size);
+
+#endif
@@ -0,0 +1,777 @@
+#include <string.h>
+
+#include "frame.h"
+#include "huffman.h"
+#include "fse.h"
+#include "cm.h"
+#include "bwt.h"
+#include "checksum.h"
+#include "histogram.h"
+#include "lz.h"
+#include "ldm.h"
+#include "timer.h"
+
+typedef struct {
+    u8* in;
+    u64 size;
+    u64 block_size;
+    frame_codec codec;
+    u32 level;
+    frame_entropy entropy;
+    b32 interleaved;
+    b32 checksum;
+    ldm_table* ldm;
+
+    u8* slots;
+    u64 slot_size;
+    u64* comp_sizes;
+    u32* checksums;
+    frame_times* block_times; // One per block when timing, NULL otherwise
+} compress_job;
+
+typedef struct {
+    u8* in;
+    u8* out;
+    frame_index_entry* index;
+    b32 checksum;
+    b32 ldm;
+    u32* checksums;
+    frame_times* block_times;
+    b32 failed;
+} decompress_job;
+
+u64 frame_index_size(u64 num_blocks) {
+    return sizeof(block_header) + num_blocks * sizeof(frame_index_entry) + sizeof(frame_footer);
+}
+
+u64 frame_block_size(u64 block_size) {
+    return CLAMP(block_size, FRAME_MIN_BLOCK_SIZE, FRAME_MAX_BLOCK_SIZE);
+}
+
+u64 frame_slot_size(u64 block_size) {
+    return sizeof(block_header) + MAX(HUFF_BLOCK_BOUND(block_size), FSE_BLOCK_BOUND(block_size)) + sizeof(u32);
+}
+
+u64 frame_bound(u64 size, u64 block_size) {
+    block_size = frame_block_size(block_size);
+    u64 num_blocks = (size + block_size - 1) / block_size;
+    return sizeof(frame_header) + num_blocks * frame_slot_size(MIN(block_size, size)) +
+        frame_index_size(num_blocks);
+}
+
+void frame_write_header(frame_header* header, u64 block_size, u8 flags) {
+    memset(header, 0, sizeof(frame_header));
+    header->magic = FRAME_MAGIC;
+    header->version = FRAME_VERSION;
+    header->flags = flags;
+    header->block_size = (u32)frame_block_size(block_size);
+}
+
+u32 frame_checksum(u32* block_checksums, u64 num_blocks, u32 crc) {
+    return crc32c(crc, (u8*)block_checksums, num_blocks * sizeof(u32));
+}
+
+b32 frame_check_header(frame_header* header) {
+    return header->magic == FRAME_MAGIC &&
+        header->version == FRAME_VERSION &&
+        header->block_size >= FRAME_MIN_BLOCK_SIZE &&
+        header->block_size <= FRAME_MAX_BLOCK_SIZE;
+}
+
+// The clock is only read for runs that asked for times
+static u64 step_start(frame_times* times) {
+    return times != NULL ? timer_now_ns() : 0;
+}
+
+static void step_end(frame_times* times, frame_step step, u64 start, u64 bytes) {
+    if (times == NULL) { return; }
+
+    times->ns[step] += timer_now_ns() - start;
+    times->bytes[step] += bytes;
+}
+
+// Blocks time themselves into their own entry so workers never share one,
+// the entries are summed once the pool is done
+static void add_block_times(frame_times* total, frame_times* block_times, u64 num_blocks) {
+    for (u64 i = 0; i < num_blocks; i++) {
+        for (u32 s = 0; s < FRAME_STEP_COUNT; s++) {
+            total->ns[s] += block_times[i].ns[s];
+            total->bytes[s] += block_times[i].bytes[s];
+        }
+    }
+}
+
+// Codes a block with an entropy coder alone. In auto mode both coders
+// run and the smaller result is kept. counts is the histogram of in,
+// taken once by the caller and shared by both coders.
+static u64 entropy_compress(
+    compress_job* job, mem_arena* arena, u8* in, u64 size, u32* counts, u8* type, u8* payload,
+    frame_times* times
+) {
+    u64 huff_size = 0;
+
+    if (job->entropy != FRAME_ENTROPY_FSE) {
+        huff_timings timings = { 0 };
+        huff_timings* huff_times = times != NULL ? &timings : NULL;
+
+        *type = job->interleaved ? BLOCK_HUFF_X4 : BLOCK_HUFF;
+        huff_size = job->interleaved ?
+            huff_compress_block_x4(arena, in, size, counts, payload, huff_times) :
+            huff_compress_block(arena, in, size, counts, payload, huff_times);
+
+        if (times != NULL) {
+            times->ns[FRAME_STEP_TREE] += timings.tree_ns;
+            times->ns[FRAME_STEP_CODES] += timings.codes_ns;
+            times->ns[FRAME_STEP_ENCODE] += timings.encode_ns;
+            for (u32 s = FRAME_STEP_TREE; s <= FRAME_STEP_ENCODE; s++) { times->bytes[s] += size; }
+        }
+
+        if (job->entropy == FRAME_ENTROPY_HUFF) { return huff_size; }
+    }
+
+    b32 keep_huff = job->entropy == FRAME_ENTROPY_AUTO;
+    u8* fse_out = keep_huff ? PUSH_ARRAY_NZ(arena, u8, FSE_BLOCK_BOUND(size)) : payload;
+
+    u64 start = step_start(times);
+    u64 fse_size = fse_compress_block(arena, in, size, counts, fse_out);
+    step_end(times, FRAME_STEP_ENCODE, start, size);
+
+    if (keep_huff) {
+        if (fse_size >= huff_size) { return huff_size; }
+        memcpy(payload, fse_out, fse_size);
+    }
+
+    *type = BLOCK_FSE;
+    return fse_size;
+}
+
+static void compress_block_task(void* ctx, u64 index, mem_arena* arena) {
+    compress_job* job = (compress_job*)ctx;
+    frame_times* times = job->block_times != NULL ? &job->block_times[index] : NULL;
+
+    u64 raw_offset = index * job->block_size;
+    u64 raw_size = MIN(job->block_size, job->size - raw_offset);
+
+    u8* slot = job->slots + index * job->slot_size;
+    block_header* bh = (block_header*)slot;
+    u8* payload = slot + sizeof(block_header);
+
+    u8* raw = job->in + raw_offset;
+    u8* in = raw;
+    u64 size = raw_size;
+    u64 comp_size = 0;
+    u8 type = BLOCK_LZ;
+
+    // Long copies are taken out first, the bytes between them are coded
+    // below as if they were the whole block
+    u64 ldm_size = 0;
+    if (job->ldm != NULL) {
+        ldm_copy* copies = PUSH_ARRAY_NZ(arena, ldm_copy, raw_size / LDM_MIN_MATCH + 1);
+        u64 num_copies = ldm_find_copies(job->ldm, job->in, raw_offset, raw_offset + raw_size, copies);
+
+        if (num_copies > 0) {
+            in = PUSH_ARRAY_NZ(arena, u8, raw_size);
+            size = 0;
+
+            u64 cursor = 0;
+            for (u64 i = 0; i <= num_copies; i++) {
+                u64 next = i < num_copies ? copies[i].dst : raw_size;
+                memcpy(in + size, raw + cursor, next - cursor);
+                size += next - cursor;
+                if (i < num_copies) { cursor = next + copies[i].length; }
+            }
+
+            *(u32*)payload = (u32)num_copies;
+            memcpy(payload + sizeof(u32), copies, num_copies * sizeof(ldm_copy));
+            ldm_size = sizeof(u32) + num_copies * sizeof(ldm_copy) + 1;
+            payload += ldm_size;
+        }
+    }
+
+    // The histogram picks the cheap cases before any coder runs: a single
+    // repeated byte becomes an RLE block, and data an order 0 coder cannot
+    // shrink is stored unless LZ, CM or BWT can find structure in it
+    u32 counts[HUFF_SYMBOLS];
+    u64 start = step_start(times);
+    hist_count(in, size, counts);
+    step_end(times, FRAME_STEP_HISTOGRAM, start, size);
+
+    u64 stored_limit = size - size / FRAME_STORED_MARGIN;
+    b32 incompressible = hist_entropy_bits(counts, size) / 8 >= stored_limit;
+
+    if (size > 0 && counts[in[0]] == size) {
+        type = BLOCK_RLE;
+        payload[0] = in[0];
+        comp_size = 1;
+    } else {
+        // Blocks LZ, CM or BWT cannot fit in the slot fall back to the
+        // entropy coder alone
+        start = step_start(times);
+        if (size == 0) {
+            // Copies cover the whole block
+        } else if (job->codec == FRAME_CODEC_LZ) {
+            comp_size = lz_compress_block(arena, in, size, payload, HUFF_BLOCK_BOUND(size), job->level);
+        } else if (job->codec == FRAME_CODEC_CM) {
+            type = BLOCK_CM;
+            comp_size = cm_compress_block(arena, in, size, payload, HUFF_BLOCK_BOUND(size));
+        } else if (job->codec == FRAME_CODEC_BWT) {
+            type = BLOCK_BWT;
+            comp_size = bwt_compress_block(arena, in, size, payload, HUFF_BLOCK_BOUND(size));
+        }
+        if (size > 0 && job->codec != FRAME_CODEC_HUFF) { step_end(times, FRAME_STEP_ENCODE, start, size); }
+
+        if (comp_size == 0 && !incompressible) {
+            comp_size = entropy_compress(job, arena, in, size, counts, &type, payload, times);
+        }
+
+        if (comp_size == 0 || comp_size >= stored_limit) {
+            type = BLOCK_STORED;
+            memcpy(payload, in, size);
+            comp_size = size;
+        }
+    }
+
+    if (ldm_size > 0) {
+        payload -= ldm_size;
+        payload[ldm_size - 1] = type;
+        type = BLOCK_LDM;
+        comp_size += ldm_size;
+    }
+
+    // Checksummed while the block is still in cache
+    if (job->checksum) {
+        u32 crc = crc32c(0, raw, raw_size);
+        memcpy(payload + comp_size, &crc, sizeof(crc));
+        comp_size += sizeof(crc);
+
+        if (job->checksums != NULL) { job->checksums[index] = crc; }
+    }
+
+    bh->type = type;
+    bh->raw_size = (u32)raw_size;
+    bh->comp_size = (u32)comp_size;
+
+    job->comp_sizes[index] = sizeof(block_header) + bh->comp_size;
+}
+
+static void compress_blocks(
+    frame_options* opts, u8* in, u64 size,
+    u8* slots, u64* comp_sizes, u32* checksums, ldm_table* ldm, frame_times* block_times
+) {
+    u64 block_size = frame_block_size(opts->block_size);
+
+    compress_job job = {
+        .in = in,
+        .size = size,
+        .block_size = block_size,
+        .codec = opts->codec,
+        .level = opts->level,
+        .entropy = opts->entropy,
+        .interleaved = opts->interleaved,
+        .checksum = opts->checksum,
+        .ldm = ldm,
+        .slots = slots,
+        .slot_size = frame_slot_size(MIN(block_size, size)),
+        .comp_sizes = comp_sizes,
+        .checksums = checksums,
+        .block_times = block_times
+    };
+
+    thread_pool_run(opts->pool, compress_block_task, &job, (size + block_size - 1) / block_size);
+}
+
+void frame_compress_blocks(
+    frame_options* opts, u8* in, u64 size,
+    u8* slots, u64* comp_sizes, u32* checksums
+) {
+    compress_blocks(opts, in, size, slots, comp_sizes, checksums, NULL, NULL);
+}
+
+// Blocks are compressed in parallel into fixed size slots and then packed
+// down in order. Packing only ever moves a block towards the front, so it
+// can happen in place.
+u64 frame_compress(mem_arena* arena, frame_options* opts, u8* in, u64 size, u8* out) {
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    u64 block_size = frame_block_size(opts->block_size);
+    u64 slot_size = frame_slot_size(MIN(block_size, size));
+    u64 num_blocks = (size + block_size - 1) / block_size;
+
+    // The whole input is at hand, so blocks can copy from each other
+    ldm_table* ldm = NULL;
+    if (opts->ldm_table_log > 0 && size > block_size) {
+        ldm = ldm_table_build(arena, in, size, opts->ldm_table_log);
+    }
+
+    u8 flags = (opts->checksum ? FRAME_FLAG_CHECKSUM : 0) | (ldm != NULL ? FRAME_FLAG_LDM : 0);
+    frame_write_header((frame_header*)out, block_size, flags);
+
+    u8* slots = out + sizeof(frame_header);
+    u64* comp_sizes = PUSH_ARRAY(arena, u64, num_blocks);
+    u32* checksums = PUSH_ARRAY(arena, u32, num_blocks);
+    frame_times* block_times = opts->times != NULL ? PUSH_ARRAY(arena, frame_times, num_blocks) : NULL;
+    compress_blocks(opts, in, size, slots, comp_sizes, checksums, ldm, block_times);
+
+    if (block_times != NULL) { add_block_times(opts->times, block_times, num_blocks); }
+
+    frame_index_entry* index = PUSH_ARRAY(arena, frame_index_entry, num_blocks);
+    u8* cursor = out + sizeof(frame_header);
+
+    for (u64 i = 0; i < num_blocks; i++) {
+        memmove(cursor, slots + i * slot_size, comp_sizes[i]);
+
+        index[i].raw_offset = i * block_size;
+        index[i].comp_offset = (u64)(cursor - out);
+        cursor += comp_sizes[i];
+    }
+
+    block_header* ih = (block_header*)cursor;
+    ih->type = BLOCK_INDEX;
+    ih->raw_size = opts->checksum ? frame_checksum(checksums, num_blocks, 0) : 0;
+    ih->comp_size = (u32)(frame_index_size(num_blocks) - sizeof(block_header));
+    cursor += sizeof(block_header);
+
+    memcpy(cursor, index, num_blocks * sizeof(frame_index_entry));
+    cursor += num_blocks * sizeof(frame_index_entry);
+
+    frame_footer* footer = (frame_footer*)cursor;
+    footer->raw_size = size;
+    footer->num_blocks = (u32)num_blocks;
+    footer->magic = FRAME_FOOTER_MAGIC;
+    cursor += sizeof(frame_footer);
+
+    arena_temp_end(temp);
+
+    return (u64)(cursor - out);
+}
+
+b32 frame_is_frame(u8* in, u64 size) {
+    return size >= sizeof(frame_header) && ((frame_header*)in)->magic == FRAME_MAGIC;
+}
+
+// The footer ending at end, if it is one and the BLOCK_INDEX header in
+// front of its seek table agrees on the size
+static frame_footer* footer_at(u8* in, u64 end) {
+    if (end < sizeof(frame_header) + frame_index_size(0)) { return NULL; }
+
+    frame_footer* footer = (frame_footer*)(in + end - sizeof(frame_footer));
+    if (footer->magic != FRAME_FOOTER_MAGIC) { return NULL; }
+
+    u64 index_size = frame_index_size(footer->num_blocks);
+    if (index_size > end - sizeof(frame_header)) { return NULL; }
+
+    block_header* ih = (block_header*)(in + end - index_size);
+    if (ih->type != BLOCK_INDEX || ih->comp_size != index_size - sizeof(block_header)) { return NULL; }
+
+    // No block holds more than block_size bytes
+    if (footer->raw_size > (u64)footer->num_blocks * ((frame_header*)in)->block_size) { return NULL; }
+
+    return footer;
+}
+
+// Finds the footer of an indexed frame and cuts size down to the end of
+// it. That is the end of the input unless an append was cut short: the
+// blocks are then walked from the front and the frame ends with the last
+// complete seek table, the torn blocks after it are not part of it yet.
+static frame_footer* read_footer(u8* in, u64* size) {
+    if (!frame_is_frame(in, *size)) { return NULL; }
+    if (((frame_header*)in)->flags & FRAME_FLAG_STREAM) { return NULL; }
+
+    frame_footer* footer = footer_at(in, *size);
+    if (footer != NULL) { return footer; }
+
+    u64 offset = sizeof(frame_header);
+    u64 end = 0;
+    while (offset + sizeof(block_header) <= *size) {
+        block_header* bh = (block_header*)(in + offset);
+        if (bh->comp_size > *size - offset - sizeof(block_header)) { break; }
+
+        offset += sizeof(block_header) + bh->comp_size;
+
+        frame_footer* last = bh->type == BLOCK_INDEX ? footer_at(in, offset) : NULL;
+        if (last != NULL) {
+            footer = last;
+            end = offset;
+        }
+    }
+
+    if (footer != NULL) { *size = end; }
+
+    return footer;
+}
+
+// Walks the block headers of a frame without an index. Fills index when
+// it is not NULL and returns the number of data blocks, or -1 if the
+// headers run past the end of the input. checksum receives the frame
+// checksum from the BLOCK_END header.
+static i64 scan_blocks(u8* in, u64 size, frame_index_entry* index, u64* raw_size, u32* checksum) {
+    u64 offset = sizeof(frame_header);
+    u64 raw_offset = 0;
+    i64 num_blocks = 0;
+
+    while (offset + sizeof(block_header) <= size) {
+        block_header* bh = (block_header*)(in + offset);
+        if (bh->type == BLOCK_END) {
+            *raw_size = raw_offset;
+            *checksum = bh->raw_size;
+            return num_blocks;
+        }
+
+        if (bh->comp_size > size - offset - sizeof(block_header)) { return -1; }
+
+        if (bh->type != BLOCK_INDEX) {
+            if (index != NULL) {
+                index[num_blocks].raw_offset = raw_offset;
+                index[num_blocks].comp_offset = offset;
+            }
+
+            raw_offset += bh->raw_size;
+            num_blocks++;
+        }
+
+        offset += sizeof(block_header) + bh->comp_size;
+    }
+
+    return -1;
+}
+
+u64 frame_raw_size(u8* in, u64 size) {
+    u64 frame_size = size;
+    frame_footer* footer = read_footer(in, &frame_size);
+    if (footer != NULL) { return footer->raw_size; }
+
+    u64 raw_size = 0;
+    u32 checksum = 0;
+    if (!frame_is_frame(in, size) || scan_blocks(in, size, NULL, &raw_size, &checksum) < 0) { return 0; }
+
+    return raw_size;
+}
+
+static b32 check_index(u8* in, u64 data_end, frame_index_entry* index, u64 num_blocks, u64 out_size) {
+    for (u64 i = 0; i < num_blocks; i++) {
+        u64 offset = index[i].comp_offset;
+        if (offset < sizeof(frame_header) || offset + sizeof(block_header) > data_end) {
+            return false;
+        }
+
+        block_header* bh = (block_header*)(in + offset);
+        if (bh->comp_size > data_end - offset - sizeof(block_header)) { return false; }
+        if (index[i].raw_offset > out_size || bh->raw_size > out_size - index[i].raw_offset) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static b32 decode_payload(mem_arena* arena, u8 type, u8* payload, u64 payload_size, u8* out, u64 raw_size) {
+    switch (type) {
+        case BLOCK_HUFF: return huff_decompress_block(arena, payload, payload_size, out, raw_size);
+        case BLOCK_HUFF_X4: return huff_decompress_block_x4(arena, payload, payload_size, out, raw_size);
+        case BLOCK_FSE: return fse_decompress_block(arena, payload, payload_size, out, raw_size);
+        case BLOCK_LZ: return lz_decompress_block(arena, payload, payload_size, out, raw_size);
+        case BLOCK_CM: return cm_decompress_block(arena, payload, payload_size, out, raw_size);
+        case BLOCK_BWT: return bwt_decompress_block(arena, payload, payload_size, out, raw_size);
+
+        case BLOCK_STORED: {
+            if (payload_size != raw_size) { return false; }
+            memcpy(out, payload, payload_size);
+            return true;
+        }
+
+        case BLOCK_RLE: {
+            if (payload_size != 1) { return false; }
+            memset(out, payload[0], raw_size);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Places the bytes between the copies of a BLOCK_LDM block, the copies
+// themselves are left to apply_copies
+static b32 decode_ldm_literals(mem_arena* arena, u8* payload, u64 payload_size, u8* out, u64 raw_size) {
+    if (payload_size < sizeof(u32)) { return false; }
+
+    u64 num_copies = *(u32*)payload;
+    u64 header_size = sizeof(u32) + num_copies * sizeof(ldm_copy) + 1;
+    if (num_copies > raw_size / LDM_MIN_MATCH || payload_size < header_size) { return false; }
+
+    ldm_copy* copies = (ldm_copy*)(payload + sizeof(u32));
+    u8 type = payload[header_size - 1];
+
+    u64 cursor = 0;
+    u64 literal_size = 0;
+    for (u64 i = 0; i < num_copies; i++) {
+        if (copies[i].dst < cursor || copies[i].length > raw_size - copies[i].dst) { return false; }
+        literal_size += copies[i].dst - cursor;
+        cursor = (u64)copies[i].dst + copies[i].length;
+    }
+    literal_size += raw_size - cursor;
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    u8* literals = PUSH_ARRAY_NZ(arena, u8, literal_size);
+    b32 ok = type != BLOCK_LDM &&
+        decode_payload(arena, type, payload + header_size, payload_size - header_size, literals, literal_size);
+
+    cursor = 0;
+    u8* lit = literals;
+    for (u64 i = 0; i <= num_copies && ok; i++) {
+        u64 next = i < num_copies ? copies[i].dst : raw_size;
+        memcpy(out + cursor, lit, next - cursor);
+        lit += next - cursor;
+        if (i < num_copies) { cursor = next + copies[i].length; }
+    }
+
+    arena_temp_end(temp);
+
+    return ok;
+}
+
+static void decompress_block_task(void* ctx, u64 index, mem_arena* arena) {
+    decompress_job* job = (decompress_job*)ctx;
+    frame_times* times = job->block_times != NULL ? &job->block_times[index] : NULL;
+
+    frame_index_entry* entry = &job->index[index];
+    block_header* bh = (block_header*)(job->in + entry->comp_offset);
+    u8* payload = (u8*)(bh + 1);
+    u8* out = job->out + entry->raw_offset;
+
+    u64 payload_size = bh->comp_size;
+    u32 expected = 0;
+
+    if (job->checksum) {
+        if (payload_size < sizeof(u32)) {
+            __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+            return;
+        }
+
+        payload_size -= sizeof(u32);
+        memcpy(&expected, payload + payload_size, sizeof(u32));
+    }
+
+    // LDM blocks are only complete, and checked, once their copies are in
+    u64 start = step_start(times);
+    if (bh->type == BLOCK_LDM) {
+        if (!job->ldm || !decode_ldm_literals(arena, payload, payload_size, out, bh->raw_size)) {
+            __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+        }
+        step_end(times, FRAME_STEP_DECODE, start, bh->raw_size);
+        return;
+    }
+
+    b32 ok = decode_payload(arena, bh->type, payload, payload_size, out, bh->raw_size);
+    step_end(times, FRAME_STEP_DECODE, start, bh->raw_size);
+
+    // Verified right after decoding, while the block is still in cache
+    if (ok && job->checksum) {
+        u32 crc = crc32c(0, out, bh->raw_size);
+        ok = crc == expected;
+
+        if (job->checksums != NULL) { job->checksums[index] = crc; }
+    }
+
+    if (!ok) { __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED); }
+}
+
+// Copies read from output that is final by the time they run: earlier
+// blocks and the literals of every block are decoded, and copies are
+// filled in order with sources that end before they start
+static b32 apply_copies(decompress_job* job, u64 num_blocks) {
+    for (u64 i = 0; i < num_blocks; i++) {
+        block_header* bh = (block_header*)(job->in + job->index[i].comp_offset);
+        if (bh->type != BLOCK_LDM) { continue; }
+
+        u8* payload = (u8*)(bh + 1);
+        u64 num_copies = *(u32*)payload;
+        ldm_copy* copies = (ldm_copy*)(payload + sizeof(u32));
+        u64 base = job->index[i].raw_offset;
+
+        for (u64 j = 0; j < num_copies; j++) {
+            u64 dst = base + copies[j].dst;
+            if (copies[j].src > dst || copies[j].length > dst - copies[j].src) { return false; }
+            memcpy(job->out + dst, job->out + copies[j].src, copies[j].length);
+        }
+
+        if (job->checksum) {
+            u32 expected;
+            memcpy(&expected, payload + bh->comp_size - sizeof(u32), sizeof(u32));
+
+            u32 crc = crc32c(0, job->out + base, bh->raw_size);
+            if (crc != expected) { return false; }
+
+            if (job->checksums != NULL) { job->checksums[i] = crc; }
+        }
+    }
+
+    return true;
+}
+
+static b32 decompress_blocks(
+    frame_options* opts, u8 flags, u8* in, frame_index_entry* index,
+    u64 num_blocks, u8* out, u32* checksums, frame_times* block_times
+) {
+    decompress_job job = {
+        .in = in,
+        .out = out,
+        .index = index,
+        .checksum = (flags & FRAME_FLAG_CHECKSUM) != 0,
+        .ldm = (flags & FRAME_FLAG_LDM) != 0,
+        .checksums = checksums,
+        .block_times = block_times,
+        .failed = false
+    };
+
+    thread_pool_run(opts->pool, decompress_block_task, &job, num_blocks);
+
+    return !job.failed && (!job.ldm || apply_copies(&job, num_blocks));
+}
+
+b32 frame_decompress_blocks(
+    frame_options* opts, u8 flags, u8* in, frame_index_entry* index,
+    u64 num_blocks, u8* out, u32* checksums
+) {
+    return decompress_blocks(opts, flags, in, index, num_blocks, out, checksums, NULL);
+}
+
+// Finds the index of a frame, from the footer or by walking the block
+// headers of streamed frames. data_end is where the last data block ends.
+static b32 load_index(
+    mem_arena* arena, u8* in, u64 size,
+    frame_index_entry** index, u64* num_blocks, u64* data_end, u64* raw_size, u32* checksum
+) {
+    if (!frame_is_frame(in, size) || !frame_check_header((frame_header*)in)) { return false; }
+
+    frame_footer* footer = read_footer(in, &size);
+
+    if (footer != NULL) {
+        *data_end = size - frame_index_size(footer->num_blocks);
+        *index = (frame_index_entry*)(in + *data_end + sizeof(block_header));
+        *num_blocks = footer->num_blocks;
+        *raw_size = footer->raw_size;
+        *checksum = ((block_header*)(in + *data_end))->raw_size;
+        return true;
+    }
+
+    i64 count = scan_blocks(in, size, NULL, raw_size, checksum);
+    if (count < 0) { return false; }
+
+    *index = PUSH_ARRAY(arena, frame_index_entry, count);
+    scan_blocks(in, size, *index, raw_size, checksum);
+    *num_blocks = (u64)count;
+    *data_end = size;
+
+    return true;
+}
+
+b32 frame_decompress(mem_arena* arena, frame_options* opts, u8* in, u64 size, u8* out, u64 out_size) {
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    frame_index_entry* index = NULL;
+    u64 num_blocks = 0;
+    u64 data_end = 0;
+    u64 raw_size = 0;
+    u32 checksum = 0;
+
+    b32 ok = load_index(arena, in, size, &index, &num_blocks, &data_end, &raw_size, &checksum);
+    ok = ok && raw_size == out_size;
+    ok = ok && check_index(in, data_end, index, num_blocks, out_size);
+
+    u8 flags = ok ? ((frame_header*)in)->flags : 0;
+    u32* checksums = PUSH_ARRAY(arena, u32, num_blocks);
+    frame_times* block_times = ok && opts->times != NULL ? PUSH_ARRAY(arena, frame_times, num_blocks) : NULL;
+
+    ok = ok && decompress_blocks(opts, flags, in, index, num_blocks, out, checksums, block_times);
+    if (block_times != NULL) { add_block_times(opts->times, block_times, num_blocks); }
+    ok = ok && (!(flags & FRAME_FLAG_CHECKSUM) || frame_checksum(checksums, num_blocks, 0) == checksum);
+
+    arena_temp_end(temp);
+
+    return ok;
+}
+
+u64 frame_find_block(frame_index_entry* index, u64 num_blocks, u64 raw_offset) {
+    u64 lo = 0;
+    u64 hi = num_blocks;
+
+    // The last entry that starts at or before raw_offset
+    while (hi - lo > 1) {
+        u64 mid = lo + (hi - lo) / 2;
+        if (index[mid].raw_offset <= raw_offset) { lo = mid; } else { hi = mid; }
+    }
+
+    return lo;
+}
+
+b32 frame_decompress_span(
+    mem_arena* arena, frame_options* opts, u8 flags, u8* in, u64 in_size,
+    frame_index_entry* index, u64 num_blocks, u64 start, u64 end, u8* out
+) {
+    if (start >= end) { return start == end; }
+    if (num_blocks == 0 || (flags & FRAME_FLAG_LDM)) { return false; }
+
+    u64 first = frame_find_block(index, num_blocks, start);
+    u64 last = frame_find_block(index, num_blocks, end - 1);
+    u64 count = last - first + 1;
+    u64 base = index[first].raw_offset;
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    // The covering blocks must be back to back in the raw data and lie
+    // inside the input. They are decoded into a buffer of their own, so
+    // the range can start and end anywhere within them.
+    frame_index_entry* span = PUSH_ARRAY(arena, frame_index_entry, count);
+    u64 raw_end = base;
+    b32 ok = base <= start;
+
+    for (u64 i = 0; i < count && ok; i++) {
+        u64 offset = index[first + i].comp_offset;
+        ok = index[first + i].raw_offset == raw_end &&
+            in_size >= sizeof(block_header) && offset <= in_size - sizeof(block_header);
+        if (!ok) { break; }
+
+        block_header* bh = (block_header*)(in + offset);
+        ok = bh->comp_size <= in_size - offset - sizeof(block_header);
+
+        span[i].raw_offset = raw_end - base;
+        span[i].comp_offset = offset;
+        raw_end += bh->raw_size;
+    }
+
+    ok = ok && raw_end >= end;
+
+    if (ok) {
+        u8* blocks = PUSH_ARRAY_NZ(arena, u8, raw_end - base);
+        ok = frame_decompress_blocks(opts, flags, in, span, count, blocks, NULL);
+        if (ok) { memcpy(out, blocks + (start - base), end - start); }
+    }
+
+    arena_temp_end(temp);
+
+    return ok;
+}
+
+b32 frame_decompress_range(
+    mem_arena* arena, frame_options* opts, u8* in, u64 size,
+    u64 start, u64 end, u8* out
+) {
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    frame_index_entry* index = NULL;
+    u64 num_blocks = 0;
+    u64 data_end = 0;
+    u64 raw_size = 0;
+    u32 checksum = 0;
+
+    b32 ok = load_index(arena, in, size, &index, &num_blocks, &data_end, &raw_size, &checksum);
+    ok = ok && start <= end && end <= raw_size;
+    ok = ok && frame_decompress_span(
+        arena, opts, ((frame_header*)in)->flags, in, data_end, index, num_blocks, start, end, out
+    );
+
+    arena_temp_end(temp);
+
+    return ok;
+}
@@ -0,0 +1,193 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "base.h"
+#include "arena.h"
+#include "thread.h"
+
+// A frame splits the input into independently coded blocks:
+//
+//   frame_header
+//   block_header + payload    (one per block, in input order)
+//   block_header + index      (BLOCK_INDEX, frame_index_entry per block)
+//   frame_footer              (last bytes of the index payload)
+//
+// The footer sits at the very end so readers can find the index with one
+// seek, while the writer can still emit blocks as soon as they are done.
+// Streamed frames (FRAME_FLAG_STREAM) keep no index and end with a
+// BLOCK_END header instead, readers then walk the block headers.
+//
+// Indexed frames can be appended to (see stream_append): new blocks and a
+// new index go after the old index, which stays behind as a skipped
+// BLOCK_INDEX block. Only the last footer counts, and raw offsets of the
+// first appended block no longer fall on multiples of the block size.
+//
+// With FRAME_FLAG_CHECKSUM every block payload ends with the CRC32C of
+// its raw data, counted in comp_size. The raw_size of the BLOCK_INDEX or
+// BLOCK_END header, unused otherwise, holds the frame checksum: the
+// CRC32C of all block checksums in order, so a missing or reordered
+// block is caught without another pass over the data.
+//
+// FRAME_FLAG_LDM frames were coded with long distance matching. Their
+// BLOCK_LDM blocks copy from anywhere earlier in the frame:
+//
+//   u32 number of copies | ldm_copy per copy | u8 block type | payload
+//
+// The payload codes the bytes between the copies as a block of the given
+// type. Copies are filled in order once every block is decoded, so these
+// frames only decode whole.
+
+#define FRAME_MAGIC 0x5A465548 // Hex for "HUFZ"
+#define FRAME_FOOTER_MAGIC 0x58444E49 // Hex for "INDX"
+#define FRAME_VERSION 1
+
+#define FRAME_DEFAULT_BLOCK_SIZE MiB(1)
+#define FRAME_MIN_BLOCK_SIZE KiB(64)
+#define FRAME_MAX_BLOCK_SIZE MiB(64)
+
+// Blocks an order 0 coder cannot shrink by more than 1 / FRAME_STORED_MARGIN
+// are stored, decoding them is a memcpy
+#define FRAME_STORED_MARGIN 32
+
+typedef enum {
+    BLOCK_HUFF = 1,
+    BLOCK_LZ = 2,
+    BLOCK_HUFF_X4 = 3,
+    BLOCK_FSE = 4,
+    BLOCK_CM = 5,
+    BLOCK_STORED = 6, // The raw bytes
+    BLOCK_RLE = 7, // One byte, repeated raw_size times
+    BLOCK_BWT = 8,
+    BLOCK_LDM = 9,
+    BLOCK_END = 0xFE,
+    BLOCK_INDEX = 0xFF
+} block_type;
+
+typedef enum {
+    FRAME_FLAG_STREAM = 1 << 0,
+    FRAME_FLAG_CHECKSUM = 1 << 1,
+    FRAME_FLAG_LDM = 1 << 2
+} frame_flags;
+
+#pragma pack(push, 1)
+typedef struct {
+    u32 magic;
+    u8 version;
+    u8 flags;
+    u16 reserved;
+    u32 block_size;
+} frame_header;
+
+typedef struct {
+    u8 type;
+    u32 raw_size;
+    u32 comp_size;
+} block_header;
+
+typedef struct {
+    u64 raw_offset;
+    u64 comp_offset; // From the start of the frame to the block_header
+} frame_index_entry;
+
+typedef struct {
+    u64 raw_size;
+    u32 num_blocks;
+    u32 magic;
+} frame_footer;
+#pragma pack(pop)
+
+typedef enum {
+    FRAME_CODEC_HUFF,
+    FRAME_CODEC_LZ,
+    FRAME_CODEC_CM, // Context mixing, see cm.h
+    FRAME_CODEC_BWT // Burrows-Wheeler transform, see bwt.h
+} frame_codec;
+
+typedef enum {
+    FRAME_ENTROPY_HUFF,
+    FRAME_ENTROPY_FSE,
+    FRAME_ENTROPY_AUTO // Whichever is smaller for the block
+} frame_entropy;
+
+// Where the blocks of a frame_compress or frame_decompress call spent
+// their time. Each step is summed over every block that went through it,
+// whichever worker ran the block, and bytes is the input of the step.
+typedef enum {
+    FRAME_STEP_HISTOGRAM,
+    FRAME_STEP_TREE, // Huffman blocks only, see huff_timings
+    FRAME_STEP_CODES,
+    FRAME_STEP_ENCODE, // The coder itself, LZ, CM, BWT and FSE included
+    FRAME_STEP_DECODE,
+    FRAME_STEP_COUNT
+} frame_step;
+
+typedef struct {
+    u64 ns[FRAME_STEP_COUNT];
+    u64 bytes[FRAME_STEP_COUNT];
+} frame_times;
+
+typedef struct {
+    u64 block_size;
+    frame_codec codec;
+    u32 level; // LZ level, see lz.h
+    frame_entropy entropy; // Coder for blocks that are not LZ coded
+    b32 interleaved; // Huffman blocks use 4 interleaved streams
+    b32 checksum; // Writers add FRAME_FLAG_CHECKSUM
+    u32 ldm_table_log; // Long distance matching in frame_compress, 0 for none, see ldm.h
+    thread_pool* pool;
+    frame_times* times; // Added to by frame_compress and frame_decompress when set
+} frame_options;
+
+u64 frame_bound(u64 size, u64 block_size);
+u64 frame_compress(mem_arena* arena, frame_options* opts, u8* in, u64 size, u8* out);
+
+b32 frame_is_frame(u8* in, u64 size);
+u64 frame_raw_size(u8* in, u64 size);
+b32 frame_decompress(mem_arena* arena, frame_options* opts, u8* in, u64 size, u8* out, u64 out_size);
+
+// Random access: decodes only the blocks covering [start, end) of the raw
+// data, out holds end - start bytes. Indexed frames find them through the
+// seek table, streamed frames by walking the block headers.
+b32 frame_decompress_range(
+    mem_arena* arena, frame_options* opts, u8* in, u64 size,
+    u64 start, u64 end, u8* out
+);
+
+// Building blocks for writers that produce a frame piece by piece.
+// A slot holds one block_header plus the largest payload a block of
+// block_size bytes can compress to. Inputs shorter than a block are a
+// single block and only need a slot for their own size.
+u64 frame_block_size(u64 block_size);
+u64 frame_index_size(u64 num_blocks); // The BLOCK_INDEX block, footer included
+u64 frame_slot_size(u64 block_size);
+void frame_write_header(frame_header* header, u64 block_size, u8 flags);
+u32 frame_checksum(u32* block_checksums, u64 num_blocks, u32 crc);
+b32 frame_check_header(frame_header* header);
+
+// checksums receives the CRC32C of every block when opts->checksum or
+// FRAME_FLAG_CHECKSUM is set, it may be NULL otherwise. Decoding fails on
+// a block whose checksum does not match. Blocks are compressed without
+// long distance matching, and FRAME_FLAG_LDM frames only decode when out
+// holds the whole frame and index offsets start from its beginning.
+void frame_compress_blocks(
+    frame_options* opts, u8* in, u64 size,
+    u8* slots, u64* comp_sizes, u32* checksums
+);
+b32 frame_decompress_blocks(
+    frame_options* opts, u8 flags, u8* in, frame_index_entry* index,
+    u64 num_blocks, u8* out, u32* checksums
+);
+
+// For readers that load the seek table and only the blocks they need.
+// frame_find_block returns the block holding raw_offset. index must be
+// sorted by raw offset, its comp offsets point into in and it must cover
+// [start, end); in_size bounds the blocks. Block checksums are verified,
+// the frame checksum needs every block and is not. FRAME_FLAG_LDM frames
+// are refused.
+u64 frame_find_block(frame_index_entry* index, u64 num_blocks, u64 raw_offset);
+b32 frame_decompress_span(
+    mem_arena* arena, frame_options* opts, u8 flags, u8* in, u64 in_size,
+    frame_index_entry* index, u64 num_blocks, u64 start, u64 end, u8* out
+);
+
+#endif
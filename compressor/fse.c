@@ -0,0 +1,337 @@
+#include <string.h>
+
+#include "fse.h"
+#include "bitio.h"
+
+#define FSE_SYMBOLS 256
+#define FSE_TABLE_MASK (FSE_TABLE_SIZE - 1)
+
+// Decoding a symbol moves to new_state plus the next num_bits bits
+typedef struct {
+    u16 new_state;
+    u8 symbol;
+    u8 num_bits;
+} fse_decode_entry;
+
+// Encoder states live in [FSE_TABLE_SIZE, 2 * FSE_TABLE_SIZE). Adding
+// delta_num_bits puts the number of bits to emit for a state in the top
+// half, the state without those bits plus delta_find_state indexes the
+// symbol's slots in next_states.
+typedef struct {
+    i32 delta_find_state;
+    u32 delta_num_bits;
+} fse_symbol_transform;
+
+typedef struct {
+    u16 next_states[FSE_TABLE_SIZE];
+    fse_symbol_transform symbols[FSE_SYMBOLS];
+} fse_encode_table;
+
+// The bitstream is written front to back while the input is coded back
+// to front, so the decoder reads it from the end towards the start. bits
+// holds the last unread bits with the very last one in bit 0.
+typedef struct {
+    u8* data;
+    i64 bit_end; // Bits that are still unread are [0, bit_end)
+    u64 bits;
+} fse_reader;
+
+static inline u32 highbit(u32 v) {
+    return 31 - (u32)__builtin_clz(v);
+}
+
+// Scales counts to sum to FSE_TABLE_SIZE, every used symbol keeps at
+// least one slot. The rounding error is taken from or given to the
+// largest symbols, where it changes the cost the least.
+static void fse_normalize(u32* counts, u64 total, u16* norm) {
+    i32 sum = 0;
+
+    for (u32 s = 0; s < FSE_SYMBOLS; s++) {
+        if (counts[s] == 0) {
+            norm[s] = 0;
+            continue;
+        }
+
+        u64 n = ((u64)counts[s] * FSE_TABLE_SIZE + total / 2) / total;
+        norm[s] = (u16)MAX(n, 1);
+        sum += norm[s];
+    }
+
+    i32 diff = FSE_TABLE_SIZE - sum;
+    while (diff != 0) {
+        u32 largest = 0;
+        for (u32 s = 1; s < FSE_SYMBOLS; s++) {
+            if (norm[s] > norm[largest]) { largest = s; }
+        }
+
+        i32 step = diff > 0 ? diff : MAX(diff, 1 - (i32)norm[largest]);
+        norm[largest] = (u16)(norm[largest] + step);
+        diff -= step;
+    }
+}
+
+// Scatters the slots of every symbol over the table. The step is odd,
+// so it visits every slot once.
+static void fse_spread(u16* norm, u8* table_symbols) {
+    u32 step = (FSE_TABLE_SIZE >> 1) + (FSE_TABLE_SIZE >> 3) + 3;
+    u32 pos = 0;
+
+    for (u32 s = 0; s < FSE_SYMBOLS; s++) {
+        for (u32 i = 0; i < norm[s]; i++) {
+            table_symbols[pos] = (u8)s;
+            pos = (pos + step) & FSE_TABLE_MASK;
+        }
+    }
+}
+
+static void fse_build_encode_table(u16* norm, fse_encode_table* table) {
+    u8 table_symbols[FSE_TABLE_SIZE];
+    fse_spread(norm, table_symbols);
+
+    u32 cumul[FSE_SYMBOLS];
+    u32 total = 0;
+    for (u32 s = 0; s < FSE_SYMBOLS; s++) {
+        cumul[s] = total;
+        total += norm[s];
+    }
+
+    for (u32 u = 0; u < FSE_TABLE_SIZE; u++) {
+        table->next_states[cumul[table_symbols[u]]++] = (u16)(FSE_TABLE_SIZE + u);
+    }
+
+    total = 0;
+    for (u32 s = 0; s < FSE_SYMBOLS; s++) {
+        fse_symbol_transform* t = &table->symbols[s];
+
+        if (norm[s] == 0) {
+            t->delta_find_state = 0;
+            t->delta_num_bits = 0;
+        } else if (norm[s] == 1) {
+            t->delta_find_state = (i32)total - 1;
+            t->delta_num_bits = (FSE_TABLE_LOG << 16) - FSE_TABLE_SIZE;
+        } else {
+            u32 max_bits = FSE_TABLE_LOG - highbit(norm[s] - 1u);
+            u32 min_state = (u32)norm[s] << max_bits;
+            t->delta_find_state = (i32)total - (i32)norm[s];
+            t->delta_num_bits = (max_bits << 16) - min_state;
+        }
+
+        total += norm[s];
+    }
+}
+
+static void fse_build_decode_table(u16* norm, fse_decode_entry* table) {
+    u8 table_symbols[FSE_TABLE_SIZE];
+    fse_spread(norm, table_symbols);
+
+    u32 next[FSE_SYMBOLS];
+    for (u32 s = 0; s < FSE_SYMBOLS; s++) { next[s] = norm[s]; }
+
+    for (u32 u = 0; u < FSE_TABLE_SIZE; u++) {
+        u8 s = table_symbols[u];
+        u32 state = next[s]++;
+        u32 num_bits = FSE_TABLE_LOG - highbit(state);
+
+        table[u].symbol = s;
+        table[u].num_bits = (u8)num_bits;
+        table[u].new_state = (u16)((state << num_bits) - FSE_TABLE_SIZE);
+    }
+}
+
+static inline void fse_encode(fse_encode_table* table, u32* state, u8 symbol, bit_writer* bw) {
+    fse_symbol_transform t = table->symbols[symbol];
+    u32 num_bits = (*state + t.delta_num_bits) >> 16;
+
+    bit_writer_put(bw, *state & ((1u << num_bits) - 1), num_bits);
+    *state = table->next_states[(i32)(*state >> num_bits) + t.delta_find_state];
+}
+
+// Leaves at least 57 valid bits in the window. Before the start of the
+// data the window is padded with zeros.
+static inline void fse_refill(fse_reader* r) {
+    if (r->bit_end <= 0) {
+        r->bits = 0;
+        return;
+    }
+
+    u64 byte_end = ((u64)r->bit_end + 7) >> 3;
+    u64 word;
+
+    if (byte_end >= 8) {
+        word = load_be64(r->data + byte_end - 8);
+    } else {
+        u8 head[8] = {0};
+        memcpy(head + 8 - byte_end, r->data, byte_end);
+        word = load_be64(head);
+    }
+
+    r->bits = word >> (byte_end * 8 - (u64)r->bit_end);
+}
+
+static inline u32 fse_read(fse_reader* r, u32 n) {
+    u32 v = (u32)(r->bits & ((1ull << n) - 1));
+    r->bits >>= n;
+    r->bit_end -= n;
+    return v;
+}
+
+static inline u8 fse_decode(fse_decode_entry* table, u32* state, fse_reader* r) {
+    fse_decode_entry e = table[*state];
+    *state = e.new_state + fse_read(r, e.num_bits);
+    return e.symbol;
+}
+
+// The counts are stored for the used symbol range, each in as many bits
+// as the slots still unassigned need. Once all slots are assigned the
+// remaining symbols are implicitly zero.
+static u64 fse_write_counts(u16* norm, u8* out) {
+    u32 min_symbol = FSE_SYMBOLS - 1, max_symbol = 0;
+    for (u32 s = 0; s < FSE_SYMBOLS; s++) {
+        if (norm[s] > 0) {
+            min_symbol = MIN(min_symbol, s);
+            max_symbol = s;
+        }
+    }
+
+    bit_writer bw;
+    bit_writer_init(&bw, out);
+    bit_writer_put(&bw, min_symbol, 8);
+    bit_writer_put(&bw, max_symbol, 8);
+    bit_writer_flush(&bw);
+
+    u32 remaining = FSE_TABLE_SIZE;
+    for (u32 s = min_symbol; s <= max_symbol && remaining > 0; s++) {
+        bit_writer_put(&bw, norm[s], highbit(remaining) + 1);
+        bit_writer_flush(&bw);
+        remaining -= norm[s];
+    }
+
+    return bit_writer_finish(&bw);
+}
+
+// Returns the number of bytes read, or 0 if the counts are invalid
+static u64 fse_read_counts(u8* in, u64 in_size, u16* norm) {
+    memset(norm, 0, FSE_SYMBOLS * sizeof(u16));
+
+    bit_reader br;
+    bit_reader_init(&br, in, in_size);
+
+    u32 min_symbol = bit_reader_read(&br, 8);
+    u32 max_symbol = bit_reader_read(&br, 8);
+    if (min_symbol > max_symbol) { return 0; }
+
+    u32 remaining = FSE_TABLE_SIZE;
+    for (u32 s = min_symbol; s <= max_symbol && remaining > 0; s++) {
+        u32 count = bit_reader_read(&br, highbit(remaining) + 1);
+        if (count > remaining) { return 0; }
+
+        norm[s] = (u16)count;
+        remaining -= count;
+    }
+
+    if (remaining != 0 || br.bit_pos > in_size * 8) { return 0; }
+
+    return (br.bit_pos + 7) / 8;
+}
+
+// Symbols alternate between two states, so the decoder has two
+// independent chains of table lookups to overlap. The input is coded
+// back to front, ending with the states the decoder starts from and a
+// single 1 bit that marks where the stream ends.
+u64 fse_compress_block(mem_arena* arena, u8* in, u64 size, u32* counts, u8* out) {
+    if (size == 0) { return 0; }
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    u16 norm[FSE_SYMBOLS];
+    fse_normalize(counts, size, norm);
+
+    u64 header_size = fse_write_counts(norm, out);
+
+    fse_encode_table* table = PUSH_STRUCT_NZ(arena, fse_encode_table);
+    fse_build_encode_table(norm, table);
+
+    bit_writer bw;
+    bit_writer_init(&bw, out + header_size);
+
+    u32 state_a = FSE_TABLE_SIZE;
+    u32 state_b = FSE_TABLE_SIZE;
+    u64 i = size;
+
+    // Even positions use state a, an odd size leaves one over at the end
+    if (i & 1) {
+        i--;
+        fse_encode(table, &state_a, in[i], &bw);
+        bit_writer_flush(&bw);
+    }
+
+    // 4 codes of at most 11 bits plus 7 pending bits fit the 64-bit window
+    for (; i >= 4; i -= 4) {
+        fse_encode(table, &state_b, in[i - 1], &bw);
+        fse_encode(table, &state_a, in[i - 2], &bw);
+        fse_encode(table, &state_b, in[i - 3], &bw);
+        fse_encode(table, &state_a, in[i - 4], &bw);
+        bit_writer_flush(&bw);
+    }
+
+    if (i == 2) {
+        fse_encode(table, &state_b, in[1], &bw);
+        fse_encode(table, &state_a, in[0], &bw);
+        bit_writer_flush(&bw);
+    }
+
+    bit_writer_put(&bw, state_b & FSE_TABLE_MASK, FSE_TABLE_LOG);
+    bit_writer_put(&bw, state_a & FSE_TABLE_MASK, FSE_TABLE_LOG);
+    bit_writer_put(&bw, 1, 1);
+
+    u64 data_size = bit_writer_finish(&bw);
+
+    arena_temp_end(temp);
+
+    return header_size + data_size;
+}
+
+b32 fse_decompress_block(mem_arena* arena, u8* in, u64 in_size, u8* out, u64 out_size) {
+    if (out_size == 0) { return in_size == 0; }
+
+    u16 norm[FSE_SYMBOLS];
+    u64 header_size = fse_read_counts(in, in_size, norm);
+    if (header_size == 0 || header_size >= in_size) { return false; }
+
+    u8* data = in + header_size;
+    u64 data_size = in_size - header_size;
+
+    u8 last = data[data_size - 1];
+    if (last == 0) { return false; }
+
+    fse_reader r = {
+        .data = data,
+        .bit_end = (i64)((data_size - 1) * 8 + 7 - (u32)__builtin_ctz(last))
+    };
+
+    fse_decode_entry* table = PUSH_ARRAY_NZ(arena, fse_decode_entry, FSE_TABLE_SIZE);
+    fse_build_decode_table(norm, table);
+
+    fse_refill(&r);
+    u32 state_a = fse_read(&r, FSE_TABLE_LOG);
+    u32 state_b = fse_read(&r, FSE_TABLE_LOG);
+
+    // Each refill covers 4 symbols of at most 11 bits
+    u64 i = 0;
+    for (; i + 4 <= out_size; i += 4) {
+        fse_refill(&r);
+        out[i + 0] = fse_decode(table, &state_a, &r);
+        out[i + 1] = fse_decode(table, &state_b, &r);
+        out[i + 2] = fse_decode(table, &state_a, &r);
+        out[i + 3] = fse_decode(table, &state_b, &r);
+    }
+
+    for (; i < out_size; i++) {
+        fse_refill(&r);
+        out[i] = fse_decode(table, (i & 1) ? &state_b : &state_a, &r);
+    }
+
+    // Every bit is used and both chains end in the state the encoder
+    // started from
+    return r.bit_end == 0 && state_a == 0 && state_b == 0;
+}
@@ -0,0 +1,26 @@
+#ifndef FSE_H
+#define FSE_H
+
+#include "base.h"
+#include "arena.h"
+
+// Table based asymmetric numeral system coder (tANS, as in FSE). Symbol
+// probabilities are rounded to multiples of 1 / FSE_TABLE_SIZE instead of
+// powers of two, so skewed histograms cost a fraction of a bit per symbol
+// where Huffman needs at least one.
+
+#define FSE_TABLE_LOG 11
+#define FSE_TABLE_SIZE (1 << FSE_TABLE_LOG)
+
+// Worst case size of a block: symbol range and normalized counts of at
+// most 12 bits each, FSE_TABLE_LOG bits per symbol, the two final states,
+// the end marker and the slack the bit writer needs for its last store
+#define FSE_BLOCK_BOUND(n) (2 + (256 * 12 + 7) / 8 + ((u64)(n) * FSE_TABLE_LOG + 2 * FSE_TABLE_LOG + 1 + 7) / 8 + 8)
+
+// A block is the normalized counts followed by the bitstream. counts is
+// the histogram of in, out must hold FSE_BLOCK_BOUND(size) bytes, the
+// compressed size is returned.
+u64 fse_compress_block(mem_arena* arena, u8* in, u64 size, u32* counts, u8* out);
+b32 fse_decompress_block(mem_arena* arena, u8* in, u64 in_size, u8* out, u64 out_size);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef GEAR_H
+#define GEAR_H
+
+#include "base.h"
+
+// Gear rolling hash. Each byte shifts the hash left by one and adds the
+// byte's random value, so after GEAR_WINDOW bytes the older ones are gone
+// and the top bits depend on the whole window. Cut points taken where the
+// top bits are clear follow the content alone.
+
+#define GEAR_WINDOW 64
+
+// Fills gear with 256 values from a splitmix64 sequence started at seed
+static inline void gear_table_init(u64* gear, u64 seed) {
+    for (u32 i = 0; i < 256; i++) {
+        u64 z = (seed += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+static inline u64 gear_update(u64 hash, u64* gear, u8 byte) {
+    return (hash << 1) + gear[byte];
+}
+
+#endif
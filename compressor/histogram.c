@@ -0,0 +1,114 @@
+#include <string.h>
+
+#include "histogram.h"
+
+typedef struct {
+    u8* in;
+    u64 size;
+    u64 chunk_size;
+    u32* partial; // HIST_SYMBOLS counts per chunk
+} hist_job;
+
+void hist_count(u8* in, u64 size, u32* counts) {
+    u32 tables[HIST_TABLES][HIST_SYMBOLS];
+    memset(tables, 0, sizeof(tables));
+
+    u64 i = 0;
+
+    // One load feeds all eight tables
+    for (; i + 8 <= size; i += 8) {
+        u64 v;
+        memcpy(&v, in + i, sizeof(v));
+
+        tables[0][(u8)(v >> 0)]++;
+        tables[1][(u8)(v >> 8)]++;
+        tables[2][(u8)(v >> 16)]++;
+        tables[3][(u8)(v >> 24)]++;
+        tables[4][(u8)(v >> 32)]++;
+        tables[5][(u8)(v >> 40)]++;
+        tables[6][(u8)(v >> 48)]++;
+        tables[7][(u8)(v >> 56)]++;
+    }
+
+    for (; i < size; i++) { tables[0][in[i]]++; }
+
+    for (u32 s = 0; s < HIST_SYMBOLS; s++) {
+        u32 sum = 0;
+        for (u32 t = 0; t < HIST_TABLES; t++) { sum += tables[t][s]; }
+        counts[s] = sum;
+    }
+}
+
+static void hist_task(void* ctx, u64 index, mem_arena* arena) {
+    (void)arena;
+    hist_job* job = (hist_job*)ctx;
+
+    u64 offset = index * job->chunk_size;
+    u64 size = MIN(job->chunk_size, job->size - offset);
+
+    hist_count(job->in + offset, size, job->partial + index * HIST_SYMBOLS);
+}
+
+void hist_count_parallel(mem_arena* arena, thread_pool* pool, u8* in, u64 size, u64* counts) {
+    memset(counts, 0, HIST_SYMBOLS * sizeof(u64));
+    if (size == 0) { return; }
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    // One chunk per worker unless that makes them too small or too large
+    u64 num_threads = thread_pool_size(pool);
+    u64 chunk_size = CLAMP((size + num_threads - 1) / num_threads, HIST_MIN_CHUNK, HIST_MAX_CHUNK);
+    u64 num_chunks = (size + chunk_size - 1) / chunk_size;
+
+    hist_job job = {
+        .in = in,
+        .size = size,
+        .chunk_size = chunk_size,
+        .partial = PUSH_ARRAY_NZ(arena, u32, num_chunks * HIST_SYMBOLS)
+    };
+
+    thread_pool_run(pool, hist_task, &job, num_chunks);
+
+    for (u64 c = 0; c < num_chunks; c++) {
+        for (u32 s = 0; s < HIST_SYMBOLS; s++) {
+            counts[s] += job.partial[c * HIST_SYMBOLS + s];
+        }
+    }
+
+    arena_temp_end(temp);
+}
+
+#define HIST_LOG_FRAC_BITS 8
+
+// log2(x) in fixed point with HIST_LOG_FRAC_BITS fraction bits. The
+// mantissa is squared once per fraction bit, every time it reaches 2
+// that bit is set.
+static u64 hist_log2(u64 x) {
+    u32 whole = 63 - (u32)__builtin_clzll(x);
+    u64 m = whole >= 31 ? x >> (whole - 31) : x << (31 - whole); // 1.31
+    u64 result = (u64)whole << HIST_LOG_FRAC_BITS;
+
+    for (u32 bit = HIST_LOG_FRAC_BITS; bit-- > 0;) {
+        m = (m * m) >> 31;
+        if (m >= (2ull << 31)) {
+            m >>= 1;
+            result |= 1ull << bit;
+        }
+    }
+
+    return result;
+}
+
+u64 hist_entropy_bits(u32* counts, u64 total) {
+    if (total == 0) { return 0; }
+
+    u64 log_total = hist_log2(total);
+    u64 bits = 0;
+
+    for (u32 s = 0; s < HIST_SYMBOLS; s++) {
+        if (counts[s] == 0) { continue; }
+        bits += counts[s] * (log_total - hist_log2(counts[s]));
+    }
+
+    return bits >> HIST_LOG_FRAC_BITS;
+}
@@ -0,0 +1,30 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "base.h"
+#include "arena.h"
+#include "thread.h"
+
+#define HIST_SYMBOLS 256
+
+// Counting into one table stalls whenever the same byte repeats, each
+// increment waits on the store of the one before. Spreading consecutive
+// bytes over separate tables keeps those chains independent.
+#define HIST_TABLES 8
+
+// Inputs are split into chunks no smaller than this, and no larger than
+// what a u32 count can hold
+#define HIST_MIN_CHUNK MiB(1)
+#define HIST_MAX_CHUNK GiB(1)
+
+// size must be below 4 GiB, so no count can overflow
+void hist_count(u8* in, u64 size, u32* counts);
+
+// Counts chunks of the input on the pool's workers and merges them
+void hist_count_parallel(mem_arena* arena, thread_pool* pool, u8* in, u64 size, u64* counts);
+
+// Order 0 entropy of a histogram over total bytes, in bits. What an ideal
+// order 0 coder would need, Huffman lands a little above it.
+u64 hist_entropy_bits(u32* counts, u64 total);
+
+#endif
@@ -0,0 +1,93 @@
+#include <string.h>
+
+#include "huffctx.h"
+#include "arena.h"
+#include "thread.h"
+
+struct huff_ctx {
+    mem_arena* arena;
+    u64 arena_base;
+
+    thread_pool* pool;
+    frame_options opts;
+};
+
+huff_ctx* huff_ctx_create(frame_options* opts, u32 num_threads) {
+    mem_arena* arena = arena_create(GiB(1), MiB(1));
+    if (arena == NULL) { return NULL; }
+
+    huff_ctx* ctx = PUSH_STRUCT(arena, huff_ctx);
+    ctx->arena = arena;
+    ctx->arena_base = arena->pos;
+
+    ctx->pool = thread_pool_create(num_threads, GiB(1));
+    if (ctx->pool == NULL) {
+        arena_destroy(arena);
+        return NULL;
+    }
+
+    huff_ctx_reset(ctx, opts);
+
+    return ctx;
+}
+
+void huff_ctx_destroy(huff_ctx* ctx) {
+    thread_pool_destroy(ctx->pool);
+    arena_destroy(ctx->arena);
+}
+
+void huff_ctx_reset(huff_ctx* ctx, frame_options* opts) {
+    arena_pop_to(ctx->arena, ctx->arena_base);
+
+    if (opts != NULL) {
+        ctx->opts = *opts;
+        ctx->opts.pool = ctx->pool;
+    }
+}
+
+u64 huff_ctx_bound(huff_ctx* ctx, u64 src_size) {
+    return frame_bound(src_size, ctx->opts.block_size);
+}
+
+u64 huff_ctx_compress(huff_ctx* ctx, void* src, u64 src_size, void* dst, u64 dst_capacity) {
+    u64 bound = huff_ctx_bound(ctx, src_size);
+
+    if (dst_capacity >= bound) {
+        return frame_compress(ctx->arena, &ctx->opts, (u8*)src, src_size, (u8*)dst);
+    }
+
+    // The frame is built in slots sized for the worst case, so a tight
+    // buffer gets it through the arena
+    mem_arena_temp temp = arena_temp_begin(ctx->arena);
+
+    u8* scratch = PUSH_ARRAY_NZ(ctx->arena, u8, bound);
+    u64 comp_size = frame_compress(ctx->arena, &ctx->opts, (u8*)src, src_size, scratch);
+
+    if (comp_size <= dst_capacity) {
+        memcpy(dst, scratch, comp_size);
+    } else {
+        comp_size = 0;
+    }
+
+    arena_temp_end(temp);
+
+    return comp_size;
+}
+
+u64 huff_ctx_raw_size(void* src, u64 src_size) {
+    return frame_raw_size((u8*)src, src_size);
+}
+
+b32 huff_ctx_decompress(huff_ctx* ctx, void* src, u64 src_size, void* dst, u64 dst_capacity, u64* dst_size) {
+    if (!frame_is_frame((u8*)src, src_size)) { return false; }
+
+    u64 raw_size = frame_raw_size((u8*)src, src_size);
+    if (raw_size > dst_capacity) { return false; }
+
+    if (!frame_decompress(ctx->arena, &ctx->opts, (u8*)src, src_size, (u8*)dst, raw_size)) {
+        return false;
+    }
+
+    *dst_size = raw_size;
+    return true;
+}
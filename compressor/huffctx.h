@@ -0,0 +1,36 @@
+#ifndef HUFFCTX_H
+#define HUFFCTX_H
+
+#include "base.h"
+#include "frame.h"
+
+// Library entry point for callers that compress many messages in one
+// process. A context owns a thread pool and arenas and keeps them across
+// calls, so once it is warm a call reserves, commits and spawns nothing
+// and works from the caller's buffer straight into the caller's buffer.
+// Messages are ordinary frames, main.exe reads them like any other file.
+//
+// A context is not thread safe, use one per calling thread. With small
+// messages a single worker is the right choice, a message only has one
+// block to give to the pool.
+typedef struct huff_ctx huff_ctx;
+
+// opts->pool is ignored, the context runs on its own pool
+huff_ctx* huff_ctx_create(frame_options* opts, u32 num_threads);
+void huff_ctx_destroy(huff_ctx* ctx);
+
+// Rewinds the arenas, keeping their memory, and switches to new options
+// unless opts is NULL
+void huff_ctx_reset(huff_ctx* ctx, frame_options* opts);
+
+// dst_capacity of at least huff_ctx_bound(src_size) lets compression
+// write in place, smaller buffers cost a copy. Returns the compressed
+// size, or 0 if it does not fit.
+u64 huff_ctx_bound(huff_ctx* ctx, u64 src_size);
+u64 huff_ctx_compress(huff_ctx* ctx, void* src, u64 src_size, void* dst, u64 dst_capacity);
+
+// Fails if src is not a valid frame or its data does not fit dst
+u64 huff_ctx_raw_size(void* src, u64 src_size);
+b32 huff_ctx_decompress(huff_ctx* ctx, void* src, u64 src_size, void* dst, u64 dst_capacity, u64* dst_size);
+
+#endif
@@ -0,0 +1,532 @@
+#include <string.h>
+
+#include "huffman.h"
+#include "minheap.h"
+#include "timer.h"
+
+#define HUFF_DECODE_UNROLL 4
+
+static b32 is_leaf(huff_node* node) {
+    return node->left == NULL && node->right == NULL;
+}
+
+static void collect_depths(huff_node* node, u32 depth, u8* lengths) {
+    if (is_leaf(node)) {
+        lengths[node->value] = (u8)MIN(depth, 255);
+        return;
+    }
+
+    collect_depths(node->left, depth + 1, lengths);
+    collect_depths(node->right, depth + 1, lengths);
+}
+
+// Builds an optimal tree with heapify/treeify and then, if any code is
+// longer than max_len, redistributes the per-length code counts until the
+// Kraft sum fits again. The lengths are then handed out again in order of
+// descending frequency, so frequent symbols always keep the shorter codes.
+void huff_lengths_from_counts(mem_arena* arena, u32* counts, u8* lengths, u32 max_len) {
+    memset(lengths, 0, HUFF_SYMBOLS);
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    min_heap* heap = heapify(arena, counts, HUFF_SYMBOLS);
+    huff_node* root = treeify(arena, heap);
+
+    if (root == NULL) {
+        arena_temp_end(temp);
+        return;
+    }
+
+    if (is_leaf(root)) {
+        lengths[root->value] = 1;
+        arena_temp_end(temp);
+        return;
+    }
+
+    collect_depths(root, 0, lengths);
+    arena_temp_end(temp);
+
+    u32 num_codes[256] = {0};
+    u32 longest = 0;
+    for (u32 i = 0; i < HUFF_SYMBOLS; i++) {
+        num_codes[lengths[i]]++;
+        longest = MAX(longest, lengths[i]);
+    }
+
+    if (longest <= max_len) { return; }
+
+    for (u32 i = max_len + 1; i <= longest; i++) {
+        num_codes[max_len] += num_codes[i];
+        num_codes[i] = 0;
+    }
+
+    u32 total = 0;
+    for (u32 i = 1; i <= max_len; i++) {
+        total += num_codes[i] << (max_len - i);
+    }
+
+    while (total != (1u << max_len)) {
+        num_codes[max_len]--;
+
+        for (u32 i = max_len - 1; i > 0; i--) {
+            if (num_codes[i] != 0) {
+                num_codes[i]--;
+                num_codes[i + 1] += 2;
+                break;
+            }
+        }
+
+        total--;
+    }
+
+    u8 order[HUFF_SYMBOLS];
+    u32 num_used = 0;
+    for (u32 i = 0; i < HUFF_SYMBOLS; i++) {
+        if (counts[i] == 0) { continue; }
+
+        u32 j = num_used++;
+        while (j > 0 && counts[order[j - 1]] < counts[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = (u8)i;
+    }
+
+    u32 next = 0;
+    for (u32 len = 1; len <= max_len; len++) {
+        for (u32 k = 0; k < num_codes[len]; k++) {
+            lengths[order[next++]] = (u8)len;
+        }
+    }
+}
+
+// Codes of equal length are consecutive in symbol order, shorter codes
+// come first, so the lengths alone fully describe the code. code_lengths
+// receives the number of bits actually emitted, which is zero when only
+// one symbol is present.
+void huff_canonical_codes(u8* lengths, u32* codes, u8* code_lengths) {
+    // Only the lengths in use are cleared and walked, this runs once per
+    // table and shows up when blocks are small
+    u32 max_len = 0;
+    for (u32 i = 0; i < HUFF_SYMBOLS; i++) { max_len = MAX(max_len, lengths[i]); }
+
+    u32 num_codes[256];
+    memset(num_codes, 0, (max_len + 1) * sizeof(u32));
+
+    u32 num_used = 0;
+    for (u32 i = 0; i < HUFF_SYMBOLS; i++) {
+        num_codes[lengths[i]]++;
+        num_used += lengths[i] != 0;
+    }
+    num_codes[0] = 0;
+
+    u32 next_code[256];
+    u32 code = 0;
+    for (u32 len = 1; len <= max_len; len++) {
+        code = (code + num_codes[len - 1]) << 1;
+        next_code[len] = code;
+    }
+
+    for (u32 i = 0; i < HUFF_SYMBOLS; i++) {
+        codes[i] = lengths[i] ? next_code[lengths[i]]++ : 0;
+        code_lengths[i] = num_used == 1 ? 0 : lengths[i];
+    }
+}
+
+void huff_build_codes(u8* lengths, huff_code* codes) {
+    u32 values[HUFF_SYMBOLS];
+    u8 code_lengths[HUFF_SYMBOLS];
+    huff_canonical_codes(lengths, values, code_lengths);
+
+    for (u32 i = 0; i < HUFF_SYMBOLS; i++) {
+        codes[i].code = values[i];
+        codes[i].length = code_lengths[i];
+    }
+}
+
+// Stored as the first and last used symbol followed by the lengths
+// of that range, packed two per byte, high nibble first.
+u64 huff_write_lengths(u8* lengths, u8* out) {
+    u32 min_symbol = HUFF_SYMBOLS - 1, max_symbol = 0;
+    for (u32 i = 0; i < HUFF_SYMBOLS; i++) {
+        if (lengths[i] > 0) {
+            min_symbol = MIN(min_symbol, i);
+            max_symbol = i;
+        }
+    }
+    min_symbol = MIN(min_symbol, max_symbol);
+
+    u8* cursor = out;
+    *cursor++ = (u8)min_symbol;
+    *cursor++ = (u8)max_symbol;
+
+    for (u32 i = min_symbol; i <= max_symbol; i += 2) {
+        u8 high = lengths[i];
+        u8 low = (i + 1 <= max_symbol) ? lengths[i + 1] : 0;
+        *cursor++ = (u8)((high << 4) | low);
+    }
+
+    return (u64)(cursor - out);
+}
+
+// Returns the first byte after the lengths, or NULL if they are invalid
+u8* huff_read_lengths(u8* in, u8* end, u8* lengths) {
+    memset(lengths, 0, HUFF_SYMBOLS);
+    if (end - in < 2) { return NULL; }
+
+    u32 min_symbol = in[0];
+    u32 max_symbol = in[1];
+    u8* cursor = in + 2;
+
+    if (min_symbol > max_symbol) { return NULL; }
+    if ((u64)(end - cursor) < (max_symbol - min_symbol) / 2 + 1) { return NULL; }
+
+    for (u32 i = min_symbol; i <= max_symbol; i += 2) {
+        lengths[i] = *cursor >> 4;
+        if (i + 1 <= max_symbol) { lengths[i + 1] = *cursor & 0xF; }
+        cursor++;
+    }
+
+    for (u32 i = 0; i < HUFF_SYMBOLS; i++) {
+        if (lengths[i] > HUFF_MAX_CODE_LEN) { return NULL; }
+    }
+
+    return cursor;
+}
+
+// 4 codes of at most 11 bits plus 7 pending bits fit the 64-bit window
+void huff_encode(huff_code* codes, u8* in, u64 size, bit_writer* bw) {
+    u64 i = 0;
+
+    for (; i + 4 <= size; i += 4) {
+        bit_writer_put(bw, codes[in[i + 0]].code, codes[in[i + 0]].length);
+        bit_writer_put(bw, codes[in[i + 1]].code, codes[in[i + 1]].length);
+        bit_writer_put(bw, codes[in[i + 2]].code, codes[in[i + 2]].length);
+        bit_writer_put(bw, codes[in[i + 3]].code, codes[in[i + 3]].length);
+        bit_writer_flush(bw);
+    }
+
+    for (; i < size; i++) {
+        bit_writer_put(bw, codes[in[i]].code, codes[in[i]].length);
+        bit_writer_flush(bw);
+    }
+}
+
+// The clock is only read for callers that asked for timings
+static u64 timings_now(huff_timings* timings) {
+    return timings != NULL ? timer_now_ns() : 0;
+}
+
+static void timings_add(huff_timings* timings, u64 t0, u64 t1, u64 t2, u64 t3) {
+    if (timings == NULL) { return; }
+
+    timings->tree_ns += t1 - t0;
+    timings->codes_ns += t2 - t1;
+    timings->encode_ns += t3 - t2;
+}
+
+u64 huff_compress_block(mem_arena* arena, u8* in, u64 size, u32* counts, u8* out, huff_timings* timings) {
+    u64 t0 = timings_now(timings);
+    u8 lengths[HUFF_SYMBOLS];
+    huff_lengths_from_counts(arena, counts, lengths, HUFF_MAX_CODE_LEN);
+    u64 t1 = timings_now(timings);
+
+    huff_code codes[HUFF_SYMBOLS];
+    huff_build_codes(lengths, codes);
+
+    u64 header_size = huff_write_lengths(lengths, out);
+    u64 t2 = timings_now(timings);
+
+    bit_writer bw;
+    bit_writer_init(&bw, out + header_size);
+    huff_encode(codes, in, size, &bw);
+    u64 comp_size = header_size + bit_writer_finish(&bw);
+
+    timings_add(timings, t0, t1, t2, timings_now(timings));
+
+    return comp_size;
+}
+
+u64 huff_compress_block_x4(mem_arena* arena, u8* in, u64 size, u32* counts, u8* out, huff_timings* timings) {
+    u64 t0 = timings_now(timings);
+    u8 lengths[HUFF_SYMBOLS];
+    huff_lengths_from_counts(arena, counts, lengths, HUFF_MAX_CODE_LEN);
+    u64 t1 = timings_now(timings);
+
+    huff_code codes[HUFF_SYMBOLS];
+    huff_build_codes(lengths, codes);
+
+    u8* cursor = out + huff_write_lengths(lengths, out);
+    u64 t2 = timings_now(timings);
+    u8* jump_table = cursor;
+    cursor += (HUFF_STREAMS - 1) * sizeof(u32);
+
+    // Each stream starts where the previous one ended, overwriting the
+    // slack its writer stored past the end
+    u64 segment = (size + HUFF_STREAMS - 1) / HUFF_STREAMS;
+    for (u32 i = 0; i < HUFF_STREAMS; i++) {
+        u64 start = MIN(i * segment, size);
+        u64 end = MIN(start + segment, size);
+
+        bit_writer bw;
+        bit_writer_init(&bw, cursor);
+        huff_encode(codes, in + start, end - start, &bw);
+        u64 stream_size = bit_writer_finish(&bw);
+
+        if (i < HUFF_STREAMS - 1) { ((u32*)jump_table)[i] = (u32)stream_size; }
+        cursor += stream_size;
+    }
+
+    timings_add(timings, t0, t1, t2, timings_now(timings));
+
+    return (u64)(cursor - out);
+}
+
+// Every lookup of a table built from lengths resolves at least one
+// symbol, there are no long codes to fall back on. Each step consumes at
+// most 11 bits, so a refill covers HUFF_DECODE_UNROLL steps.
+#define HUFF_DECODE_STEP(br, op) do {                                        \
+        huff_decode_entry e = table->pairs[bit_reader_peek(&(br), HUFF_TABLE_BITS)]; \
+        (op)[0] = e.symbols[0];                                             \
+        (op)[1] = e.symbols[1];                                             \
+        (op) += e.num_symbols;                                              \
+        bit_reader_consume(&(br), e.num_bits);                              \
+    } while (0)
+
+static void huff_decode_x4(huff_decode_table* table, bit_reader* br, u8** op, u8** oend) {
+    bit_reader br0 = br[0], br1 = br[1], br2 = br[2], br3 = br[3];
+    u8* op0 = op[0];
+    u8* op1 = op[1];
+    u8* op2 = op[2];
+    u8* op3 = op[3];
+
+    // Streams decode one or two symbols per step, so they drift apart
+    // and each needs room for a full round
+    while ((u64)(oend[0] - op0) >= 2 * HUFF_DECODE_UNROLL &&
+           (u64)(oend[1] - op1) >= 2 * HUFF_DECODE_UNROLL &&
+           (u64)(oend[2] - op2) >= 2 * HUFF_DECODE_UNROLL &&
+           (u64)(oend[3] - op3) >= 2 * HUFF_DECODE_UNROLL) {
+        bit_reader_refill(&br0);
+        bit_reader_refill(&br1);
+        bit_reader_refill(&br2);
+        bit_reader_refill(&br3);
+
+        for (i32 i = 0; i < HUFF_DECODE_UNROLL; i++) {
+            HUFF_DECODE_STEP(br0, op0);
+            HUFF_DECODE_STEP(br1, op1);
+            HUFF_DECODE_STEP(br2, op2);
+            HUFF_DECODE_STEP(br3, op3);
+        }
+    }
+
+    br[0] = br0; br[1] = br1; br[2] = br2; br[3] = br3;
+    op[0] = op0; op[1] = op1; op[2] = op2; op[3] = op3;
+}
+
+b32 huff_decompress_block_x4(mem_arena* arena, u8* in, u64 in_size, u8* out, u64 out_size) {
+    u8 lengths[HUFF_SYMBOLS];
+    u8* end = in + in_size;
+    u8* cursor = huff_read_lengths(in, end, lengths);
+    if (cursor == NULL) { return false; }
+
+    u64 jump_size = (HUFF_STREAMS - 1) * sizeof(u32);
+    if ((u64)(end - cursor) < jump_size) { return false; }
+
+    u32* jump_table = (u32*)cursor;
+    cursor += jump_size;
+
+    huff_decode_table* table = huff_decode_table_from_lengths(arena, lengths, out_size);
+
+    bit_reader br[HUFF_STREAMS];
+    u8* op[HUFF_STREAMS];
+    u8* oend[HUFF_STREAMS];
+    u64 segment = (out_size + HUFF_STREAMS - 1) / HUFF_STREAMS;
+
+    for (u32 i = 0; i < HUFF_STREAMS; i++) {
+        u64 stream_size = (i < HUFF_STREAMS - 1) ? jump_table[i] : (u64)(end - cursor);
+        if ((u64)(end - cursor) < stream_size) { return false; }
+
+        bit_reader_init(&br[i], cursor, stream_size);
+        cursor += stream_size;
+
+        u64 start = MIN(i * segment, out_size);
+        op[i] = out + start;
+        oend[i] = out + MIN(start + segment, out_size);
+    }
+
+    huff_decode_x4(table, br, op, oend);
+
+    b32 ok = true;
+    for (u32 i = 0; i < HUFF_STREAMS; i++) {
+        huff_decode(table, &br[i], op[i], (u64)(oend[i] - op[i]));
+        ok = ok && br[i].bit_pos <= br[i].size * 8;
+    }
+
+    return ok;
+}
+
+b32 huff_decompress_block(mem_arena* arena, u8* in, u64 in_size, u8* out, u64 out_size) {
+    u8 lengths[HUFF_SYMBOLS];
+    u8* data = huff_read_lengths(in, in + in_size, lengths);
+    if (data == NULL) { return false; }
+
+    huff_decode_table* table = huff_decode_table_from_lengths(arena, lengths, out_size);
+
+    u64 data_size = in_size - (u64)(data - in);
+    bit_reader br;
+    bit_reader_init(&br, data, data_size);
+    huff_decode(table, &br, out, out_size);
+
+    // Running past the end means the zero padding was decoded as data
+    return br.bit_pos <= data_size * 8;
+}
+
+static void fill_singles(huff_decode_table* table, huff_node* node, u32 code, u32 depth) {
+    if (is_leaf(node)) {
+        u32 shift = HUFF_TABLE_BITS - depth;
+        u32 first = code << shift;
+        u32 last = (code + 1) << shift;
+
+        for (u32 i = first; i < last; i++) {
+            table->singles[i].symbols[0] = node->value;
+            table->singles[i].num_symbols = 1;
+            table->singles[i].num_bits = (u8)depth;
+        }
+        return;
+    }
+
+    if (depth == HUFF_TABLE_BITS) {
+        table->long_roots[code] = node;
+        return;
+    }
+
+    fill_singles(table, node->left, code << 1, depth + 1);
+    fill_singles(table, node->right, (code << 1) | 1, depth + 1);
+}
+
+static void fill_pairs(huff_decode_table* table) {
+    for (u32 i = 0; i < HUFF_TABLE_SIZE; i++) {
+        huff_decode_entry first = table->singles[i];
+        table->pairs[i] = first;
+
+        if (first.num_symbols == 0) { continue; }
+
+        u32 rest = (i << first.num_bits) & (HUFF_TABLE_SIZE - 1);
+        huff_decode_entry second = table->singles[rest];
+
+        if (second.num_symbols != 0 &&
+            first.num_bits + second.num_bits <= HUFF_TABLE_BITS) {
+            table->pairs[i].symbols[1] = second.symbols[0];
+            table->pairs[i].num_symbols = 2;
+            table->pairs[i].num_bits = first.num_bits + second.num_bits;
+        }
+    }
+}
+
+huff_decode_table* huff_decode_table_from_tree(mem_arena* arena, huff_node* root) {
+    huff_decode_table* table = PUSH_STRUCT(arena, huff_decode_table);
+    table->root = root;
+    table->pairs = PUSH_ARRAY(arena, huff_decode_entry, HUFF_TABLE_SIZE);
+    table->singles = PUSH_ARRAY(arena, huff_decode_entry, HUFF_TABLE_SIZE);
+    table->long_roots = PUSH_ARRAY(arena, huff_node*, HUFF_TABLE_SIZE);
+
+    if (root == NULL || is_leaf(root)) { return table; }
+
+    fill_singles(table, root, 0, 0);
+    fill_pairs(table);
+
+    return table;
+}
+
+huff_decode_table* huff_decode_table_from_lengths(mem_arena* arena, u8* lengths, u64 num_symbols) {
+    huff_decode_table* table = PUSH_STRUCT(arena, huff_decode_table);
+    table->singles = PUSH_ARRAY_NZ(arena, huff_decode_entry, HUFF_TABLE_SIZE);
+
+    // Slots an incomplete code leaves empty decode as symbol 0, so corrupt
+    // input produces garbage rather than a wild read
+    for (u32 i = 0; i < HUFF_TABLE_SIZE; i++) {
+        table->singles[i] = (huff_decode_entry){ .num_symbols = 1, .num_bits = HUFF_TABLE_BITS };
+    }
+
+    u32 codes[HUFF_SYMBOLS];
+    u8 code_lengths[HUFF_SYMBOLS];
+    huff_canonical_codes(lengths, codes, code_lengths);
+
+    for (u32 i = 0; i < HUFF_SYMBOLS; i++) {
+        if (lengths[i] == 0 || lengths[i] > HUFF_TABLE_BITS) { continue; }
+
+        u32 len = code_lengths[i];
+        u32 shift = HUFF_TABLE_BITS - len;
+        u32 first = len ? codes[i] << shift : 0;
+        u32 last = len ? (codes[i] + 1) << shift : HUFF_TABLE_SIZE;
+
+        for (u32 j = first; j < last && j < HUFF_TABLE_SIZE; j++) {
+            table->singles[j].symbols[0] = (u8)i;
+            table->singles[j].num_bits = (u8)len;
+        }
+    }
+
+    if (num_symbols < HUFF_PAIRS_MIN_SYMBOLS) {
+        table->pairs = table->singles;
+        return table;
+    }
+
+    table->pairs = PUSH_ARRAY_NZ(arena, huff_decode_entry, HUFF_TABLE_SIZE);
+    fill_pairs(table);
+
+    return table;
+}
+
+// Slow path for codes longer than the table: skip the resolved prefix
+// and walk the remaining bits through the tree.
+static u8 decode_long(huff_decode_table* table, bit_reader* br) {
+    huff_node* node = table->long_roots[bit_reader_peek(br, HUFF_TABLE_BITS)];
+    bit_reader_consume(br, HUFF_TABLE_BITS);
+
+    while (!is_leaf(node)) {
+        node = bit_reader_read(br, 1) ? node->right : node->left;
+    }
+
+    return node->value;
+}
+
+void huff_decode(huff_decode_table* table, bit_reader* br, u8* out, u64 size) {
+    if (table->root != NULL && is_leaf(table->root)) {
+        memset(out, table->root->value, size);
+        return;
+    }
+
+    u8* op = out;
+    u8* oend = out + size;
+
+    // Each refill leaves >= 57 bits, enough for HUFF_DECODE_UNROLL lookups
+    while ((u64)(oend - op) >= 2 * HUFF_DECODE_UNROLL) {
+        bit_reader_refill(br);
+
+        for (i32 i = 0; i < HUFF_DECODE_UNROLL; i++) {
+            huff_decode_entry e = table->pairs[bit_reader_peek(br, HUFF_TABLE_BITS)];
+
+            if (e.num_symbols == 0) {
+                *op++ = decode_long(table, br);
+                break;
+            }
+
+            op[0] = e.symbols[0];
+            op[1] = e.symbols[1];
+            op += e.num_symbols;
+            bit_reader_consume(br, e.num_bits);
+        }
+    }
+
+    while (op < oend) {
+        bit_reader_refill(br);
+        huff_decode_entry e = table->singles[bit_reader_peek(br, HUFF_TABLE_BITS)];
+
+        if (e.num_symbols == 0) {
+            *op++ = decode_long(table, br);
+        } else {
+            *op++ = e.symbols[0];
+            bit_reader_consume(br, e.num_bits);
+        }
+    }
+}
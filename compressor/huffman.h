@@ -0,0 +1,90 @@
+#ifndef HUFFMAN_H
+#define HUFFMAN_H
+
+#include "base.h"
+#include "arena.h"
+#include "bitio.h"
+#include "huffnode.h"
+
+#define HUFF_SYMBOLS 256
+#define HUFF_TABLE_BITS 11
+#define HUFF_TABLE_SIZE (1 << HUFF_TABLE_BITS)
+
+// Canonical codes are capped so a single table lookup always resolves them
+#define HUFF_MAX_CODE_LEN HUFF_TABLE_BITS
+
+#define HUFF_STREAMS 4
+
+// Filling the pair table costs about as much as decoding a few thousand
+// symbols, small blocks decode one symbol per lookup instead
+#define HUFF_PAIRS_MIN_SYMBOLS (4 * HUFF_TABLE_SIZE)
+
+// Worst case size of a block: the lengths, every symbol at the maximum
+// code length and the slack the bit writer needs for its last store.
+// Covers both layouts, a 4-stream block adds its jump table and up to
+// one partial byte per stream.
+#define HUFF_BLOCK_BOUND(n) (2 + HUFF_SYMBOLS / 2 + ((u64)(n) * HUFF_MAX_CODE_LEN + 7) / 8 + 8 + \
+    (HUFF_STREAMS - 1) * sizeof(u32) + HUFF_STREAMS)
+
+typedef struct {
+    u32 code;
+    u8 length;
+} huff_code;
+
+// One lookup of HUFF_TABLE_BITS resolves up to two symbols.
+// num_symbols == 0 marks a code longer than the table, which is
+// finished by walking the tree from long_roots[index].
+typedef struct {
+    u8 symbols[2];
+    u8 num_symbols;
+    u8 num_bits;
+} huff_decode_entry;
+
+typedef struct {
+    huff_decode_entry* pairs;
+    huff_decode_entry* singles;
+    huff_node** long_roots;
+    huff_node* root;
+} huff_decode_table;
+
+void huff_lengths_from_counts(mem_arena* arena, u32* counts, u8* lengths, u32 max_len);
+void huff_canonical_codes(u8* lengths, u32* codes, u8* code_lengths);
+void huff_build_codes(u8* lengths, huff_code* codes);
+
+u64 huff_write_lengths(u8* lengths, u8* out);
+u8* huff_read_lengths(u8* in, u8* end, u8* lengths);
+
+void huff_encode(huff_code* codes, u8* in, u64 size, bit_writer* bw);
+
+huff_decode_table* huff_decode_table_from_tree(mem_arena* arena, huff_node* root);
+// num_symbols is how many symbols the table will decode. Below
+// HUFF_PAIRS_MIN_SYMBOLS pairs aliases singles.
+huff_decode_table* huff_decode_table_from_lengths(mem_arena* arena, u8* lengths, u64 num_symbols);
+void huff_decode(huff_decode_table* table, bit_reader* br, u8* out, u64 size);
+
+// Time a block coder spent in each step, added to by the calls that are
+// given one
+typedef struct {
+    u64 tree_ns; // heapify, treeify and the length limit
+    u64 codes_ns; // Canonical codes and the stored lengths
+    u64 encode_ns;
+} huff_timings;
+
+// A block is the code lengths followed by the bitstream. counts is the
+// histogram of in, out must hold HUFF_BLOCK_BOUND(size) bytes, the
+// compressed size is returned. timings may be NULL.
+u64 huff_compress_block(mem_arena* arena, u8* in, u64 size, u32* counts, u8* out, huff_timings* timings);
+b32 huff_decompress_block(mem_arena* arena, u8* in, u64 in_size, u8* out, u64 out_size);
+
+// Same code, but the block is cut into HUFF_STREAMS equal segments (the
+// last one shorter) that are coded as separate bitstreams:
+//
+//   lengths | u32 size of streams 0-2 | stream 0 | ... | stream 3
+//
+// The decoder runs the four streams in one loop. Their bit positions do
+// not depend on each other, so the lookups overlap instead of waiting
+// on the previous symbol's length.
+u64 huff_compress_block_x4(mem_arena* arena, u8* in, u64 size, u32* counts, u8* out, huff_timings* timings);
+b32 huff_decompress_block_x4(mem_arena* arena, u8* in, u64 in_size, u8* out, u64 out_size);
+
+#endif
@@ -0,0 +1,127 @@
+#include <string.h>
+
+#include "ldm.h"
+#include "lz.h"
+
+#define LDM_MIN_SAMPLE_LOG 4
+
+typedef struct {
+    u64 hash;
+    u64 pos; // One past the end of the sampled window, 0 marks empty
+} ldm_entry;
+
+struct ldm_table {
+    ldm_entry* entries;
+    u32 table_log;
+    u32 sample_log;
+    u64 gear[256];
+};
+
+static inline b32 ldm_sampled(ldm_table* t, u64 hash) {
+    return (hash >> (64 - t->sample_log)) == 0;
+}
+
+static inline ldm_entry* ldm_slot(ldm_table* t, u64 hash) {
+    u64 index = (hash >> (64 - t->sample_log - t->table_log)) & ((1ull << t->table_log) - 1);
+    return &t->entries[index];
+}
+
+// How many bytes before a and b match, at most limit, 8 per step. The
+// highest addressed byte is the top byte of a little endian load, so the
+// matching bytes are the leading zero bytes of the difference.
+static inline u32 ldm_match_length_back(u8* a, u8* b, u32 limit) {
+    u32 len = 0;
+
+    while (len + 8 <= limit) {
+        u64 va, vb;
+        memcpy(&va, a - len - 8, sizeof(va));
+        memcpy(&vb, b - len - 8, sizeof(vb));
+
+        u64 diff = va ^ vb;
+        if (diff != 0) { return len + ((u32)__builtin_clzll(diff) >> 3); }
+        len += 8;
+    }
+
+    while (len < limit && a[-(i64)len - 1] == b[-(i64)len - 1]) { len++; }
+
+    return len;
+}
+
+ldm_table* ldm_table_build(mem_arena* arena, u8* in, u64 size, u32 table_log) {
+    table_log = CLAMP(table_log, LDM_MIN_TABLE_LOG, LDM_MAX_TABLE_LOG);
+
+    ldm_table* t = PUSH_STRUCT(arena, ldm_table);
+    t->entries = PUSH_ARRAY(arena, ldm_entry, 1ull << table_log);
+    t->table_log = table_log;
+
+    // About one sample per entry
+    u32 size_log = 0;
+    while (size_log < 63 && (1ull << size_log) < size) { size_log++; }
+    t->sample_log = MAX(LDM_MIN_SAMPLE_LOG, size_log > table_log ? size_log - table_log : 0);
+
+    gear_table_init(t->gear, 0x6C646D);
+
+    // Only the first window with a hash is kept, it is earlier than every
+    // block that could ask for it
+    u64 hash = 0;
+    for (u64 i = 0; i < size; i++) {
+        hash = gear_update(hash, t->gear, in[i]);
+
+        if (i + 1 >= LDM_WINDOW && ldm_sampled(t, hash)) {
+            ldm_entry* e = ldm_slot(t, hash);
+            if (e->pos == 0) {
+                e->hash = hash;
+                e->pos = i + 1;
+            }
+        }
+    }
+
+    return t;
+}
+
+u64 ldm_find_copies(ldm_table* t, u8* in, u64 start, u64 end, ldm_copy* copies) {
+    u64 num_copies = 0;
+    u64 literal_start = start; // Copies may not reach back before this
+    u64 window_start = start;
+    u64 hash = 0;
+
+    for (u64 i = start; i < end; i++) {
+        hash = gear_update(hash, t->gear, in[i]);
+
+        if (i + 1 - window_start < LDM_WINDOW || !ldm_sampled(t, hash)) { continue; }
+
+        ldm_entry* e = ldm_slot(t, hash);
+        if (e->pos == 0 || e->hash != hash) { continue; }
+
+        u64 dst = i + 1 - LDM_WINDOW;
+        u64 src = e->pos - LDM_WINDOW;
+        if (src + LDM_WINDOW > dst) { continue; }
+
+        // The source has to end before the copy starts, the decoder fills
+        // copies in order from output that is already final. Going back
+        // keeps the source end where it is and moves the copy start
+        // towards it.
+        u64 length = lz_match_length(in + src, in + dst, (u32)MIN(end - dst, dst - src));
+        if (length < LDM_WINDOW) { continue; }
+
+        u64 back_limit = MIN(MIN(dst - literal_start, src), dst - (src + length));
+        u64 back = ldm_match_length_back(in + src, in + dst, (u32)back_limit);
+        src -= back;
+        dst -= back;
+        length += back;
+
+        if (length < LDM_MIN_MATCH) { continue; }
+
+        copies[num_copies].dst = (u32)(dst - start);
+        copies[num_copies].length = (u32)length;
+        copies[num_copies].src = src;
+        num_copies++;
+
+        literal_start = dst + length;
+        window_start = literal_start;
+        i = literal_start - 1;
+        hash = 0;
+    }
+
+    return num_copies;
+}
@@ -0,0 +1,45 @@
+#ifndef LDM_H
+#define LDM_H
+
+#include "base.h"
+#include "arena.h"
+#include "gear.h"
+
+// Long distance matcher. Positions where a gear hash of the last
+// LDM_WINDOW bytes has its top bits clear are sampled into a table over
+// the whole input before any block is coded. Blocks then look up their
+// own sampled positions and turn long repeats into copies from anywhere
+// earlier in the input, far beyond what the LZ window can see. Sampling
+// depends only on content, so both copies of a repeat sample the same
+// spots however far apart they are.
+//
+// The table holds 2^table_log entries of 16 bytes whatever the input
+// size. Larger inputs are sampled more sparsely instead, which only
+// raises the length a repeat needs before it is found.
+
+#define LDM_WINDOW GEAR_WINDOW
+#define LDM_MIN_MATCH 128
+
+#define LDM_MIN_TABLE_LOG 10
+#define LDM_DEFAULT_TABLE_LOG 20
+#define LDM_MAX_TABLE_LOG 24
+
+// Copies the bytes at src of the whole input to dst of the block
+#pragma pack(push, 1)
+typedef struct {
+    u32 dst;
+    u32 length;
+    u64 src;
+} ldm_copy;
+#pragma pack(pop)
+
+typedef struct ldm_table ldm_table;
+
+ldm_table* ldm_table_build(mem_arena* arena, u8* in, u64 size, u32 table_log);
+
+// Finds copies into [start, end) of in, in order and without overlap.
+// copies must hold (end - start) / LDM_MIN_MATCH entries. Sources always
+// end before their copy starts.
+u64 ldm_find_copies(ldm_table* table, u8* in, u64 start, u64 end, ldm_copy* copies);
+
+#endif
@@ -0,0 +1,714 @@
+#include <string.h>
+
+#include "lz.h"
+#include "bitio.h"
+#include "huffman.h"
+#include "histogram.h"
+
+static inline u32 lz_hash(u8* p, u32 bits) {
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - bits);
+}
+
+lz_matcher* lz_matcher_create(mem_arena* arena, u32 window_size, u32 chain_depth, u32 nice_length) {
+    lz_matcher* m = PUSH_STRUCT(arena, lz_matcher);
+    m->head = PUSH_ARRAY(arena, u32, 1 << LZ_HASH_BITS);
+    m->prev = PUSH_ARRAY(arena, u32, window_size);
+    m->hash_bits = LZ_HASH_BITS;
+    m->window_size = window_size;
+    m->window_mask = window_size - 1;
+    m->chain_depth = MAX(chain_depth, 1);
+    m->nice_length = CLAMP(nice_length, LZ_MIN_MATCH, LZ_MAX_MATCH);
+
+    return m;
+}
+
+lz_matcher* lz_matcher_create_tree(mem_arena* arena, u32 window_size, u32 chain_depth, u32 nice_length) {
+    // Small windows do not need the full table, it is cleared on reset
+    u32 window_log = (u32)__builtin_ctz(window_size);
+
+    lz_matcher* m = PUSH_STRUCT(arena, lz_matcher);
+    m->hash_bits = MIN(LZ_TREE_HASH_BITS, MAX(window_log, LZ_HASH_BITS));
+    m->head = PUSH_ARRAY(arena, u32, 1 << m->hash_bits);
+    m->tree = PUSH_ARRAY(arena, u32, 2 * (u64)window_size);
+    m->window_size = window_size;
+    m->window_mask = window_size - 1;
+    m->chain_depth = MAX(chain_depth, 1);
+    m->nice_length = CLAMP(nice_length, LZ_MIN_MATCH, LZ_MAX_MATCH);
+
+    return m;
+}
+
+// Stale links are never followed, chain walks stop at the first link
+// that does not go backwards and tree walks only ever reach nodes
+// inserted after the reset, so clearing the heads is enough
+void lz_matcher_reset(lz_matcher* m) {
+    memset(m->head, 0, sizeof(u32) << m->hash_bits);
+}
+
+// Inserts pos as the new root of its tree. The old tree is split into the
+// positions that sort before and after pos, which become its children.
+// Nodes are compared from the prefix they are known to share with pos,
+// the shorter of the prefixes along the two split edges. Every match
+// longer than the ones before it is added to matches when that is not
+// NULL. A match reaching nice_length is as good as it gets, pos takes
+// over that node's children and the walk ends there.
+static token lz_tree_walk(lz_matcher* m, u8* data, u64 pos, u64 size, token* matches, u32* count) {
+    token best = { 0, LZ_MIN_MATCH - 1, 0 };
+
+    u32 max_len = (u32)MIN(LZ_MAX_MATCH, size - pos);
+    u32 limit = MIN(max_len, m->nice_length);
+    u32 h = lz_hash(data + pos, m->hash_bits);
+    u32 next = m->head[h];
+    u32 depth = m->chain_depth;
+
+    m->head[h] = (u32)pos + 1;
+
+    u32* smaller = &m->tree[2 * (pos & m->window_mask)];
+    u32* larger = smaller + 1;
+    u32 smaller_len = 0;
+    u32 larger_len = 0;
+    u8* cur = data + pos;
+
+    while (1) {
+        // A node a whole window back shares its slot with pos
+        if (next == 0 || depth-- == 0 || pos - (next - 1) >= m->window_size) {
+            *smaller = 0;
+            *larger = 0;
+            break;
+        }
+
+        u64 cand = next - 1;
+        u32* pair = &m->tree[2 * (cand & m->window_mask)];
+        u8* prev = data + cand;
+        u32 len = MIN(smaller_len, larger_len);
+
+        if (prev[len] == cur[len]) {
+            len++;
+            len += lz_match_length(prev + len, cur + len, limit - len);
+
+            if (len > best.length) {
+                best.offset = (u32)(pos - cand);
+                best.length = (u16)len;
+                if (matches != NULL) { matches[(*count)++] = best; }
+            }
+
+            if (len == limit) {
+                *smaller = pair[0];
+                *larger = pair[1];
+                break;
+            }
+        }
+
+        if (prev[len] < cur[len]) {
+            *smaller = next;
+            smaller = &pair[1];
+            next = *smaller;
+            smaller_len = len;
+        } else {
+            *larger = next;
+            larger = &pair[0];
+            next = *larger;
+            larger_len = len;
+        }
+    }
+
+    // The tree only compares up to nice_length, the match itself can go on
+    if (best.length == limit && limit < max_len) {
+        u8* prev = cur - best.offset;
+        best.length = (u16)(limit + lz_match_length(prev + limit, cur + limit, max_len - limit));
+        if (matches != NULL) { matches[*count - 1].length = best.length; }
+    }
+
+    if (best.length < LZ_MIN_MATCH) {
+        best.offset = 0;
+        best.length = 0;
+    }
+
+    return best;
+}
+
+void lz_insert(lz_matcher* m, u8* data, u64 pos, u64 size) {
+    if (pos + LZ_MIN_MATCH > size) { return; }
+
+    if (m->tree != NULL) {
+        lz_tree_walk(m, data, pos, size, NULL, NULL);
+        return;
+    }
+
+    u32 h = lz_hash(data + pos, m->hash_bits);
+    m->prev[pos & m->window_mask] = m->head[h];
+    m->head[h] = (u32)pos + 1;
+}
+
+token lz_find_match(lz_matcher* m, u8* data, u64 pos, u64 size) {
+    token match = { 0, 0, data[pos] };
+    if (pos + LZ_MIN_MATCH > size) { return match; }
+
+    if (m->tree != NULL) {
+        match = lz_tree_walk(m, data, pos, size, NULL, NULL);
+        match.next_char = (pos + match.length < size) ? data[pos + match.length] : 0;
+        return match;
+    }
+
+    u32 limit = (u32)MIN(LZ_MAX_MATCH, size - pos);
+    u32 h = lz_hash(data + pos, m->hash_bits);
+    u32 next = m->head[h];
+    u32 depth = m->chain_depth;
+
+    m->prev[pos & m->window_mask] = next;
+    m->head[h] = (u32)pos + 1;
+
+    // Chain links older than the window may have been overwritten by
+    // newer positions, so stop as soon as one does not go backwards
+    u64 last = pos;
+    while (next != 0 && depth-- > 0) {
+        u64 cand = next - 1;
+        if (cand >= last || pos - cand > m->window_size) { break; }
+
+        if (data[cand + match.length] == data[pos + match.length]) {
+            u32 len = lz_match_length(data + cand, data + pos, limit);
+
+            if (len > match.length) {
+                match.offset = (u32)(pos - cand);
+                match.length = (u16)len;
+                if (len == limit || len >= m->nice_length) { break; }
+            }
+        }
+
+        last = cand;
+        next = m->prev[cand & m->window_mask];
+    }
+
+    if (match.length < LZ_MIN_MATCH) {
+        match.offset = 0;
+        match.length = 0;
+    }
+
+    match.next_char = (pos + match.length < size) ? data[pos + match.length] : 0;
+
+    return match;
+}
+
+u32 lz_find_matches(lz_matcher* m, u8* data, u64 pos, u64 size, token* matches) {
+    if (pos + LZ_MIN_MATCH > size) { return 0; }
+
+    u32 count = 0;
+    if (m->tree != NULL) {
+        lz_tree_walk(m, data, pos, size, matches, &count);
+        return count;
+    }
+
+    u32 limit = (u32)MIN(LZ_MAX_MATCH, size - pos);
+    u32 h = lz_hash(data + pos, m->hash_bits);
+    u32 next = m->head[h];
+    u32 depth = m->chain_depth;
+
+    m->prev[pos & m->window_mask] = next;
+    m->head[h] = (u32)pos + 1;
+
+    u32 best = LZ_MIN_MATCH - 1;
+    u64 last = pos;
+
+    while (next != 0 && depth-- > 0) {
+        u64 cand = next - 1;
+        if (cand >= last || pos - cand > m->window_size) { break; }
+
+        if (data[cand + best] == data[pos + best]) {
+            u32 len = lz_match_length(data + cand, data + pos, limit);
+
+            if (len > best) {
+                matches[count].offset = (u32)(pos - cand);
+                matches[count].length = (u16)len;
+                matches[count].next_char = 0;
+                count++;
+
+                best = len;
+                if (len == limit || len >= m->nice_length) { break; }
+            }
+        }
+
+        last = cand;
+        next = m->prev[cand & m->window_mask];
+    }
+
+    return count;
+}
+
+typedef struct {
+    u32 lit_len;
+    u32 match_len;
+    u32 offset;
+} lz_sequence;
+
+// Output of a parse. Parsers only report matches, the literals between
+// them are collected as they go.
+typedef struct {
+    lz_sequence* seqs;
+    u64 num_seqs;
+    u8* literals;
+    u64 num_literals;
+    u64 lit_start;
+} lz_parse_state;
+
+typedef enum {
+    LZ_PARSE_GREEDY,
+    LZ_PARSE_LAZY,
+    LZ_PARSE_OPTIMAL
+} lz_parser;
+
+// The optimal levels search a binary tree, the others hash chains
+typedef struct {
+    lz_parser parser;
+    u32 window_log;
+    u32 chain_depth;
+    u32 nice_length;
+} lz_level;
+
+static const lz_level lz_levels[LZ_MAX_LEVEL + 1] = {
+    [1] = { LZ_PARSE_GREEDY,  18,   1,  16 },
+    [2] = { LZ_PARSE_GREEDY,  18,   4,  32 },
+    [3] = { LZ_PARSE_GREEDY,  20,   8,  64 },
+    [4] = { LZ_PARSE_LAZY,    20,   8,  64 },
+    [5] = { LZ_PARSE_LAZY,    20,  16, 128 },
+    [6] = { LZ_PARSE_LAZY,    22,  32, 255 },
+    [7] = { LZ_PARSE_LAZY,    22, 128, 255 },
+    [8] = { LZ_PARSE_OPTIMAL, 24,  32,  64 },
+    [9] = { LZ_PARSE_OPTIMAL, 24, 256, 128 }
+};
+
+// The optimal parser works on chunks of this many positions at a time
+// so its state stays small no matter how large the block is
+#define LZ_OPT_CHUNK 4096
+
+typedef struct {
+    u32 price;
+    u32 length; // Zero for a literal
+    u32 offset;
+} lz_opt_node;
+
+// Bit costs taken from the code lengths of a previous parse. Match
+// lengths include their extra bits, offsets only the code.
+typedef struct {
+    u32 literal[HUFF_SYMBOLS];
+    u32 match_len[LZ_MAX_MATCH + 1];
+    u32 offset[HUFF_SYMBOLS];
+    u32 sequence; // Literal length code of a match with no literals before it
+} lz_prices;
+
+typedef enum {
+    LZ_STREAM_LITERALS,
+    LZ_STREAM_LIT_LENS,
+    LZ_STREAM_MATCH_LENS,
+    LZ_STREAM_OFFSETS,
+    LZ_STREAM_COUNT
+} lz_stream;
+
+// Values below 16 are their own symbol. Larger values are bucketed by
+// their highest bit and the bit below it, the remaining bits follow raw.
+// The largest bucket holds values with bit 31 set.
+#define LZ_MAX_VALUE_CODE (16 + (31 - 4) * 2 + 1)
+
+static inline u8 lz_value_code(u32 value, u32* num_extra, u32* extra) {
+    if (value < 16) {
+        *num_extra = 0;
+        *extra = 0;
+        return (u8)value;
+    }
+
+    u32 high = 31 - (u32)__builtin_clz(value);
+    *num_extra = high - 1;
+    *extra = value & ((1u << (high - 1)) - 1);
+
+    return (u8)(16 + (high - 4) * 2 + ((value >> (high - 1)) & 1));
+}
+
+static inline u32 lz_value_decode(u8 code, bit_reader* br) {
+    if (code < 16) { return code; }
+
+    u32 high = (code - 16) / 2 + 4;
+    u32 top = 2 | ((code - 16) & 1);
+
+    return (top << (high - 1)) | bit_reader_read(br, high - 1);
+}
+
+static void lz_emit(lz_parse_state* ps, u8* in, u64 pos, u32 length, u32 offset) {
+    u64 lit_len = pos - ps->lit_start;
+    memcpy(ps->literals + ps->num_literals, in + ps->lit_start, lit_len);
+    ps->num_literals += lit_len;
+
+    lz_sequence* seq = &ps->seqs[ps->num_seqs++];
+    seq->lit_len = (u32)lit_len;
+    seq->match_len = length;
+    seq->offset = offset;
+
+    ps->lit_start = pos + length;
+}
+
+static void lz_emit_tail(lz_parse_state* ps, u8* in, u64 size) {
+    memcpy(ps->literals + ps->num_literals, in + ps->lit_start, size - ps->lit_start);
+    ps->num_literals += size - ps->lit_start;
+    ps->lit_start = size;
+}
+
+// A minimum length match far back usually costs more bits than its
+// literals, zlib drops them the same way (TOO_FAR)
+#define LZ_FAR_OFFSET 4096
+
+static inline token lz_worth_taking(token match) {
+    if (match.length == LZ_MIN_MATCH && match.offset > LZ_FAR_OFFSET) { match.length = 0; }
+    return match;
+}
+
+// Lazy parsing looks one position ahead before taking a match and
+// emits a literal instead when the match starting there is longer
+static void lz_parse_greedy(lz_matcher* m, u8* in, u64 size, b32 lazy, lz_parse_state* ps) {
+    u64 pos = 0;
+    u64 inserted = 0;
+    token match = { 0 };
+    b32 have_match = false;
+
+    while (pos < size) {
+        if (!have_match) {
+            match = lz_worth_taking(lz_find_match(m, in, pos, size));
+            inserted = pos + 1;
+        }
+        have_match = false;
+
+        if (match.length == 0) {
+            pos++;
+            continue;
+        }
+
+        if (lazy && match.length < m->nice_length && pos + 1 < size) {
+            token next = lz_worth_taking(lz_find_match(m, in, pos + 1, size));
+            inserted = pos + 2;
+
+            if (next.length > match.length) {
+                match = next;
+                pos++;
+                have_match = true;
+                continue;
+            }
+        }
+
+        lz_emit(ps, in, pos, match.length, match.offset);
+
+        for (u64 i = MAX(inserted, pos + 1); i < pos + match.length; i++) {
+            lz_insert(m, in, i, size);
+        }
+
+        pos += match.length;
+    }
+
+    lz_emit_tail(ps, in, size);
+}
+
+static u32 lz_value_bits(u32* code_prices, u32 value) {
+    u32 num_extra, extra;
+    u8 code = lz_value_code(value, &num_extra, &extra);
+    return code_prices[code] + num_extra;
+}
+
+static void lz_stream_prices(mem_arena* arena, u32* counts, u32* prices) {
+    u8 lengths[HUFF_SYMBOLS];
+    huff_lengths_from_counts(arena, counts, lengths, HUFF_MAX_CODE_LEN);
+
+    // Symbols the previous parse never used are priced like the
+    // longest code, so the parser can still pick them when they pay off
+    for (u32 i = 0; i < HUFF_SYMBOLS; i++) {
+        prices[i] = lengths[i] != 0 ? lengths[i] : HUFF_MAX_CODE_LEN;
+    }
+}
+
+static void lz_compute_prices(mem_arena* arena, lz_parse_state* ps, lz_prices* prices) {
+    u32 counts[LZ_STREAM_COUNT][HUFF_SYMBOLS] = { 0 };
+
+    for (u64 i = 0; i < ps->num_literals; i++) {
+        counts[LZ_STREAM_LITERALS][ps->literals[i]]++;
+    }
+
+    for (u64 i = 0; i < ps->num_seqs; i++) {
+        u32 values[3] = { ps->seqs[i].lit_len, ps->seqs[i].match_len - LZ_MIN_MATCH, ps->seqs[i].offset - 1 };
+
+        for (u32 j = 0; j < 3; j++) {
+            u32 num_extra, extra;
+            counts[LZ_STREAM_LIT_LENS + j][lz_value_code(values[j], &num_extra, &extra)]++;
+        }
+    }
+
+    u32 lit_len_prices[HUFF_SYMBOLS];
+    u32 match_len_prices[HUFF_SYMBOLS];
+
+    lz_stream_prices(arena, counts[LZ_STREAM_LITERALS], prices->literal);
+    lz_stream_prices(arena, counts[LZ_STREAM_LIT_LENS], lit_len_prices);
+    lz_stream_prices(arena, counts[LZ_STREAM_MATCH_LENS], match_len_prices);
+    lz_stream_prices(arena, counts[LZ_STREAM_OFFSETS], prices->offset);
+
+    for (u32 len = LZ_MIN_MATCH; len <= LZ_MAX_MATCH; len++) {
+        prices->match_len[len] = lz_value_bits(match_len_prices, len - LZ_MIN_MATCH);
+    }
+
+    prices->sequence = lit_len_prices[0];
+}
+
+// Finds the cheapest way to code each chunk with a shortest path over
+// its positions, every literal and every match length of every match
+// found is an edge. Matches do not cross chunk boundaries, and a match
+// of at least nice_length is taken as is and its positions are skipped.
+static void lz_parse_optimal(
+    mem_arena* arena, lz_matcher* m, u8* in, u64 size,
+    lz_prices* prices, lz_parse_state* ps
+) {
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    lz_opt_node* nodes = PUSH_ARRAY_NZ(arena, lz_opt_node, LZ_OPT_CHUNK + 1);
+    lz_opt_node* path = PUSH_ARRAY_NZ(arena, lz_opt_node, LZ_OPT_CHUNK);
+    token* matches = PUSH_ARRAY_NZ(arena, token, m->chain_depth);
+
+    for (u64 start = 0; start < size; start += LZ_OPT_CHUNK) {
+        u32 n = (u32)MIN(LZ_OPT_CHUNK, size - start);
+
+        nodes[0].price = 0;
+        for (u32 i = 1; i <= n; i++) { nodes[i].price = UINT32_MAX; }
+
+        u32 i = 0;
+        while (i < n) {
+            u64 pos = start + i;
+            u32 price = nodes[i].price;
+
+            u32 lit_price = price + prices->literal[in[pos]];
+            if (lit_price < nodes[i + 1].price) {
+                nodes[i + 1].price = lit_price;
+                nodes[i + 1].length = 0;
+            }
+
+            u32 count = lz_find_matches(m, in, pos, size, matches);
+            u32 len = LZ_MIN_MATCH;
+            u32 skip = 1;
+
+            for (u32 j = 0; j < count; j++) {
+                u32 offset = matches[j].offset;
+                u32 max_len = MIN(matches[j].length, n - i);
+                u32 match_price = price + prices->sequence + lz_value_bits(prices->offset, offset - 1);
+
+                if (matches[j].length >= m->nice_length) {
+                    len = max_len;
+                    skip = MAX(max_len, 1);
+                }
+
+                for (; len <= max_len; len++) {
+                    u32 total = match_price + prices->match_len[len];
+                    if (total < nodes[i + len].price) {
+                        nodes[i + len].price = total;
+                        nodes[i + len].length = len;
+                        nodes[i + len].offset = offset;
+                    }
+                }
+            }
+
+            for (u32 j = 1; j < skip; j++) {
+                lz_insert(m, in, pos + j, size);
+            }
+
+            i += skip;
+        }
+
+        u32 path_len = 0;
+        for (u32 j = n; j > 0;) {
+            if (nodes[j].length == 0) {
+                j--;
+            } else {
+                path[path_len++] = nodes[j];
+                j -= nodes[j].length;
+                path[path_len - 1].price = j;
+            }
+        }
+
+        // The path was collected back to front, price now holds the start
+        while (path_len > 0) {
+            lz_opt_node* node = &path[--path_len];
+            lz_emit(ps, in, start + node->price, node->length, node->offset);
+        }
+    }
+
+    lz_emit_tail(ps, in, size);
+
+    arena_temp_end(temp);
+}
+
+static void lz_parse(mem_arena* arena, u8* in, u64 size, u32 level, lz_parse_state* ps) {
+    lz_level params = lz_levels[CLAMP(level, LZ_MIN_LEVEL, LZ_MAX_LEVEL)];
+
+    // Matches cannot reach outside the block, so neither does the window
+    u32 window_log = LZ_MIN_WINDOW_LOG;
+    while (window_log < params.window_log && (1ull << window_log) < size) { window_log++; }
+
+    lz_matcher* m = params.parser == LZ_PARSE_OPTIMAL ?
+        lz_matcher_create_tree(arena, 1u << window_log, params.chain_depth, params.nice_length) :
+        lz_matcher_create(arena, 1u << window_log, params.chain_depth, params.nice_length);
+
+    lz_parse_greedy(m, in, size, params.parser != LZ_PARSE_GREEDY, ps);
+    if (params.parser != LZ_PARSE_OPTIMAL) { return; }
+
+    // The optimal parse is priced with the code lengths of a lazy parse
+    // of the same block, then replaces it
+    lz_prices prices;
+    lz_compute_prices(arena, ps, &prices);
+
+    lz_matcher_reset(m);
+    ps->num_seqs = 0;
+    ps->num_literals = 0;
+    ps->lit_start = 0;
+
+    lz_parse_optimal(arena, m, in, size, &prices, ps);
+}
+
+u64 lz_compress_block(mem_arena* arena, u8* in, u64 size, u8* out, u64 capacity, u32 level) {
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    lz_parse_state ps = {
+        .seqs = PUSH_ARRAY_NZ(arena, lz_sequence, size / LZ_MIN_MATCH + 1),
+        .literals = PUSH_ARRAY_NZ(arena, u8, size)
+    };
+    lz_parse(arena, in, size, level, &ps);
+
+    lz_sequence* seqs = ps.seqs;
+    u8* literals = ps.literals;
+    u64 num_seqs = ps.num_seqs;
+    u64 num_literals = ps.num_literals;
+
+    u8* codes[LZ_STREAM_COUNT] = { literals };
+    u64 counts[LZ_STREAM_COUNT] = { num_literals, num_seqs, num_seqs, num_seqs };
+    for (u32 i = LZ_STREAM_LIT_LENS; i < LZ_STREAM_COUNT; i++) {
+        codes[i] = PUSH_ARRAY_NZ(arena, u8, num_seqs);
+    }
+
+    // Every value carries at most 30 extra bits
+    u8* extra_bits = PUSH_ARRAY_NZ(arena, u8, num_seqs * 12 + 8);
+    bit_writer bw;
+    bit_writer_init(&bw, extra_bits);
+
+    for (u64 i = 0; i < num_seqs; i++) {
+        u32 values[3] = { seqs[i].lit_len, seqs[i].match_len - LZ_MIN_MATCH, seqs[i].offset - 1 };
+
+        for (u32 j = 0; j < 3; j++) {
+            u32 num_extra, extra;
+            codes[LZ_STREAM_LIT_LENS + j][i] = lz_value_code(values[j], &num_extra, &extra);
+            bit_writer_put(&bw, extra, num_extra);
+            bit_writer_flush(&bw);
+        }
+    }
+
+    u64 extra_size = bit_writer_finish(&bw);
+
+    u8* scratch = PUSH_ARRAY_NZ(arena, u8, HUFF_BLOCK_BOUND(size));
+    u8* cursor = out;
+    u8* end = out + capacity;
+    b32 fits = capacity >= 2 * sizeof(u32);
+
+    if (fits) {
+        *(u32*)cursor = (u32)num_seqs;
+        *(u32*)(cursor + 4) = (u32)num_literals;
+        cursor += 2 * sizeof(u32);
+    }
+
+    for (u32 i = 0; i < LZ_STREAM_COUNT && fits; i++) {
+        u32 histogram[HUFF_SYMBOLS];
+        hist_count(codes[i], counts[i], histogram);
+
+        u64 stream_size = huff_compress_block(arena, codes[i], counts[i], histogram, scratch, NULL);
+        fits = (u64)(end - cursor) >= sizeof(u32) + stream_size;
+
+        if (fits) {
+            *(u32*)cursor = (u32)stream_size;
+            memcpy(cursor + sizeof(u32), scratch, stream_size);
+            cursor += sizeof(u32) + stream_size;
+        }
+    }
+
+    fits = fits && (u64)(end - cursor) >= extra_size;
+    if (fits) {
+        memcpy(cursor, extra_bits, extra_size);
+        cursor += extra_size;
+    }
+
+    arena_temp_end(temp);
+
+    return fits ? (u64)(cursor - out) : 0;
+}
+
+b32 lz_decompress_block(mem_arena* arena, u8* in, u64 in_size, u8* out, u64 out_size) {
+    if (in_size < 2 * sizeof(u32)) { return false; }
+
+    u8* cursor = in;
+    u8* end = in + in_size;
+
+    u64 num_seqs = *(u32*)cursor;
+    u64 num_literals = *(u32*)(cursor + 4);
+    cursor += 2 * sizeof(u32);
+
+    if (num_literals > out_size || num_seqs > out_size / LZ_MIN_MATCH) { return false; }
+
+    u64 counts[LZ_STREAM_COUNT] = { num_literals, num_seqs, num_seqs, num_seqs };
+    u8* codes[LZ_STREAM_COUNT];
+
+    for (u32 i = 0; i < LZ_STREAM_COUNT; i++) {
+        if ((u64)(end - cursor) < sizeof(u32)) { return false; }
+
+        u64 stream_size = *(u32*)cursor;
+        cursor += sizeof(u32);
+        if ((u64)(end - cursor) < stream_size) { return false; }
+
+        codes[i] = PUSH_ARRAY_NZ(arena, u8, counts[i]);
+        if (!huff_decompress_block(arena, cursor, stream_size, codes[i], counts[i])) {
+            return false;
+        }
+        cursor += stream_size;
+    }
+
+    bit_reader br;
+    bit_reader_init(&br, cursor, (u64)(end - cursor));
+
+    u8* op = out;
+    u8* oend = out + out_size;
+    u8* lit = codes[LZ_STREAM_LITERALS];
+    u8* lit_end = lit + num_literals;
+
+    for (u64 i = 0; i < num_seqs; i++) {
+        // Larger codes would shift and read past 32 bits
+        if (codes[LZ_STREAM_LIT_LENS][i] > LZ_MAX_VALUE_CODE || codes[LZ_STREAM_MATCH_LENS][i] > LZ_MAX_VALUE_CODE ||
+            codes[LZ_STREAM_OFFSETS][i] > LZ_MAX_VALUE_CODE) {
+            return false;
+        }
+
+        u64 lit_len = lz_value_decode(codes[LZ_STREAM_LIT_LENS][i], &br);
+        u64 match_len = lz_value_decode(codes[LZ_STREAM_MATCH_LENS][i], &br) + LZ_MIN_MATCH;
+        u64 offset = lz_value_decode(codes[LZ_STREAM_OFFSETS][i], &br) + 1;
+
+        if (lit_len > (u64)(lit_end - lit) || lit_len + match_len > (u64)(oend - op)) {
+            return false;
+        }
+
+        memcpy(op, lit, lit_len);
+        op += lit_len;
+        lit += lit_len;
+
+        if (offset > (u64)(op - out)) { return false; }
+
+        u8* match = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, match, match_len);
+        } else {
+            for (u64 j = 0; j < match_len; j++) { op[j] = match[j]; }
+        }
+        op += match_len;
+    }
+
+    u64 tail = (u64)(lit_end - lit);
+    if (tail != (u64)(oend - op)) { return false; }
+    memcpy(op, lit, tail);
+
+    return br.bit_pos <= br.size * 8;
+}
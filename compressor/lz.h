@@ -0,0 +1,115 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "base.h"
+#include "arena.h"
+
+#define LZ_WINDOW_SIZE 4096
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_MATCH 255
+
+#define LZ_HASH_BITS 15
+#define LZ_TREE_HASH_BITS 20
+#define LZ_DEFAULT_CHAIN_DEPTH 32
+
+// Block codec windows, never larger than the block itself
+#define LZ_MIN_WINDOW_LOG 12
+#define LZ_MAX_WINDOW_LOG 24
+
+// Levels 1-3 parse greedily, 4-7 lazily and 8-9 with a price based
+// optimal parser over a binary tree, searching deeper and over a larger
+// window as the level goes up
+#define LZ_MIN_LEVEL 1
+#define LZ_MAX_LEVEL 9
+#define LZ_DEFAULT_LEVEL 6
+
+typedef struct {
+    u32 offset;
+    u16 length;
+    u8 next_char;
+} token;
+
+// Hash chains over the window: head holds the most recent position for
+// each hash of LZ_MIN_MATCH bytes, prev links every position in the window
+// to the previous one with the same hash. Positions are stored plus one
+// so zero can mean empty.
+//
+// Tree matchers keep a binary tree per hash instead, tree holds the
+// smaller and larger child of every position in the window. Each new
+// position becomes the root, so a search visits the closest candidates
+// first and only follows the ones sharing the longest prefix, which
+// keeps deep searches over multi-megabyte windows affordable.
+typedef struct {
+    u32* head;
+    u32* prev;
+    u32* tree;
+
+    u32 hash_bits;
+    u32 window_size;
+    u32 window_mask;
+    u32 chain_depth;
+    u32 nice_length; // Searches stop at the first match this long
+} lz_matcher;
+
+// window_size must be a power of two. For tree matchers chain_depth
+// limits the number of tree nodes visited per search.
+lz_matcher* lz_matcher_create(mem_arena* arena, u32 window_size, u32 chain_depth, u32 nice_length);
+lz_matcher* lz_matcher_create_tree(mem_arena* arena, u32 window_size, u32 chain_depth, u32 nice_length);
+void lz_matcher_reset(lz_matcher* m);
+
+void lz_insert(lz_matcher* m, u8* data, u64 pos, u64 size);
+
+// Returns the longest match for pos, preferring the closest on ties,
+// and inserts pos into the matcher. A length of zero means no match.
+token lz_find_match(lz_matcher* m, u8* data, u64 pos, u64 size);
+
+// Like lz_find_match, but returns every match that is longer than the
+// ones before it, shortest first. matches needs room for chain_depth.
+u32 lz_find_matches(lz_matcher* m, u8* data, u64 pos, u64 size, token* matches);
+
+// Compares 32 bytes per step with AVX2 and 8 bytes per step without it,
+// the first mismatching byte is the lowest set bit of the difference
+// (x86 is little endian). Matches may overlap, a is always before b.
+static inline u32 lz_match_length(u8* a, u8* b, u32 limit) {
+    u32 len = 0;
+
+#if defined(__AVX2__)
+    while (len + 32 <= limit) {
+        __m256i va = _mm256_loadu_si256((__m256i*)(a + len));
+        __m256i vb = _mm256_loadu_si256((__m256i*)(b + len));
+        u32 diff = ~(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+
+        if (diff != 0) { return len + (u32)__builtin_ctz(diff); }
+        len += 32;
+    }
+#endif
+
+    while (len + 8 <= limit) {
+        u64 va, vb;
+        memcpy(&va, a + len, sizeof(va));
+        memcpy(&vb, b + len, sizeof(vb));
+
+        u64 diff = va ^ vb;
+        if (diff != 0) { return len + ((u32)__builtin_ctzll(diff) >> 3); }
+        len += 8;
+    }
+
+    while (len < limit && a[len] == b[len]) { len++; }
+    return len;
+}
+
+// Two-stage block codec. The input is parsed into sequences of a literal
+// run followed by a match. Literals, literal run lengths, match lengths
+// and offsets are each coded with their own Huffman table; lengths and
+// offsets as a bucket symbol plus raw extra bits in a shared bitstream.
+// Returns 0 if the block does not fit capacity bytes.
+u64 lz_compress_block(mem_arena* arena, u8* in, u64 size, u8* out, u64 capacity, u32 level);
+b32 lz_decompress_block(mem_arena* arena, u8* in, u64 in_size, u8* out, u64 out_size);
+
+#endif
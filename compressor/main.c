@@ -1,16 +1,37 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#endif
+
 #include "base.h"
 #include "arena.h"
 #include "minheap.h"
 #include "huffnode.h"
+#include "huffman.h"
+#include "histogram.h"
+#include "lz.h"
+#include "ldm.h"
+#include "archive.h"
+#include "frame.h"
+#include "huffctx.h"
+#include "checksum.h"
+#include "mapfile.h"
+#include "stream.h"
+#include "stats.h"
+#include "thread.h"
+#include "timer.h"
 
 // ./main -c test/test.txt test/test_comp.txt
 // ./main -d test/test_comp.txt test/test_decomp.txt
+// cat test/test.txt | ./main -sc - | ./main -sd - > test/test_decomp.txt
 
 #define ASCII_UNIQUE 256
 #define HEADER_MAGIC 0x46465548 // Hex for "HUFF"
+#define HEADER_MAGIC_V2 0x32465548 // Hex for "HUF2"
 
 typedef struct {
     u8* str;
@@ -21,24 +42,19 @@ typedef struct {
 #define STR8_FMT(s) (int)(s).size, (char*)(s).str
 
 typedef struct {
-    string8 bits;
-} code;
-
-typedef struct {
-    code* codes;
-} code_table;
-
-typedef struct {
-    u8* data;
-    u64 byte_idx;
-    i32 bit_idx;
-} bit_writer;
-
-typedef struct {
-    u8* data;
-    u64 byte_idx;
-    i32 bit_idx;
-} bit_reader;
+    u32 num_threads;
+    u64 block_size;
+    frame_codec codec;
+    u32 level;
+    frame_entropy entropy;
+    b32 interleaved;
+    b32 checksum;
+    u32 ldm_table_log;
+    u64 range_start;
+    u64 range_end;
+    u64 tail_size;
+    stats_format stats;
+} options;
 
 #pragma pack(push, 1)
 typedef struct {
@@ -46,15 +62,16 @@ typedef struct {
     u64 original_size;
     u16 unique_chars;
 } huff_header;
-#pragma pack(pop)
 
+// Followed by the code lengths, see huff_write_lengths
 typedef struct {
-    u8* file_start;
-    u8* data_start;
-} header_write_buffer;
+    u32 magic;
+    u64 original_size;
+} huff_header_v2;
+#pragma pack(pop)
 
 typedef struct {
-    huff_node* root;
+    huff_decode_table* table;
     u64 original_size;
     u8* data_start;
 } header_read_buffer;
@@ -63,35 +80,50 @@ b32 extract_args(
     mem_arena* arena, int argc, char** argv,
     char** mode, char** filename_in, char** filename_out
 );
+b32 extract_options(int argc, char** argv, i32 first, options* opts);
 
-string8* string_read(mem_arena* arena, const char* filename);
+string8* string_read(mem_arena* arena, const char* filename, file_map* map);
 void string_write(const char* filename, string8* s);
 
-string8* compress(mem_arena* arena, string8* s);
-string8* decompress(mem_arena* arena, string8* s);
+string8* compress(mem_arena* arena, string8* s, frame_options* opts);
+string8* decompress(mem_arena* arena, string8* s, frame_options* opts);
 
-header_write_buffer write_header(mem_arena* arena, u64 original_size, u32* counts);
 header_read_buffer read_header(mem_arena* arena, string8* s);
 
-void generate_codes(
-    mem_arena* arena, code_table* table,
-    huff_node* node, char* path, i32 depth
-);
-
-void write_bits(bit_writer* bw, string8* bits);
-u8 read_bit(bit_reader* br);
-
-typedef struct {
-    u16 offset;
-    u16 length;
-    u8 next_char;
-} token;
+void bench_huffman(mem_arena* arena, string8* s, u64 block_size);
+void bench_histogram(mem_arena* arena, thread_pool* pool, string8* s);
+void bench_codecs(mem_arena* arena, string8* s, frame_options* base);
+void bench_checksum(mem_arena* arena, string8* s, frame_options* base);
+void bench_messages(mem_arena* arena, string8* s, frame_options* base);
 
-string8* lz_compress(mem_arena* arena, string8* s);
+b32 run_with_stats(
+    mem_arena* arena, frame_options* opts, b32 compressing,
+    const char* filename_in, const char* filename_out, stats_format format
+);
 
 int main(int argc, char** argv) {
     if (argc < 3) {
-        printf("Usage: ./main -(c/d) <input_file>\n");
+        printf("Usage: ./main -(c/d/t/sc/sd/dr/a/bh/bc/bm/ax) <input_file|-> | -ac <archive> <files...>\n"
+            "    [-j threads] [-B block_kib] [-lz | -1..-9 | -cm | -bwt] [-x4] [-e huff|fse|auto]\n"
+            "    [-crc] [-ldm | -ldm-log n] [-R start end | -tail n] [-v [json|csv]]\n");
+        return 1;
+    }
+
+    options opts = {
+        .num_threads = plat_get_core_count(),
+        .block_size = FRAME_DEFAULT_BLOCK_SIZE,
+        .codec = FRAME_CODEC_HUFF,
+        .level = LZ_DEFAULT_LEVEL,
+        .entropy = FRAME_ENTROPY_HUFF
+    };
+    // -ac lists its input files between the archive and the options
+    i32 first_option = 3;
+    if (strcmp(argv[1], "-ac") == 0) {
+        while (first_option < argc && argv[first_option][0] != '-') { first_option++; }
+    }
+
+    if (!extract_options(argc, argv, first_option, &opts)) {
+        printf("Invalid options\n");
         return 1;
     }
 
@@ -101,38 +133,214 @@ int main(int argc, char** argv) {
     extract_args(perm_arena, argc, argv, &mode, &filename_in, &filename_out);
     // printf("Mode: %s | In: %s | Out: %s\n", *mode, *filename_in, *filename_out);
 
-    if (strcmp(mode, "-c") == 0) {
-        string8* s = string_read(perm_arena, filename_in);
-        // string8* lz = lz_compress(perm_arena, s);
-        string8* cs = compress(perm_arena, s);
-        string_write(filename_out, cs);
+    // Every worker codes whole blocks, so its arena only needs block sized state
+    thread_pool* pool = thread_pool_create(opts.num_threads, GiB(1));
+    frame_options fopts = {
+        .block_size = opts.block_size,
+        .codec = opts.codec,
+        .level = opts.level,
+        .entropy = opts.entropy,
+        .interleaved = opts.interleaved,
+        .checksum = opts.checksum,
+        .ldm_table_log = opts.ldm_table_log,
+        .pool = pool
+    };
 
-        printf("%lld bytes -> %lld bytes (%.1f%%)\n", s->size, cs->size,
-            (1.0f - (f32)cs->size / s->size) * 100.0f);
+    int exit_code = 0;
+
+    // Long distance matching samples the whole input before the first
+    // block is coded, streamed and appended blocks cannot wait for that
+    if (opts.ldm_table_log > 0 && (strcmp(mode, "-sc") == 0 || strcmp(mode, "-a") == 0)) {
+        fprintf(stderr, "-ldm needs the whole input and only works with -c\n");
+        exit_code = 1;
+    } else if (opts.stats != STATS_NONE && (strcmp(mode, "-c") == 0 || strcmp(mode, "-d") == 0)) {
+        if (!run_with_stats(perm_arena, &fopts, mode[1] == 'c', filename_in, filename_out, opts.stats)) {
+            printf("Failed: %s\n", filename_in);
+            exit_code = 1;
+        }
+    } else if (strcmp(mode, "-c") == 0) {
+        // Frames are coded straight from the mapped input into the mapped
+        // output, the arena copies are only used when mapping fails
+        file_map in_map;
+        file_map out_map;
+        string8* s = string_read(perm_arena, filename_in, &in_map);
+
+        if (s == NULL) {
+            printf("Could not read: %s\n", filename_in);
+        } else {
+            string8 cs;
+            if (file_map_create(&out_map, filename_out, frame_bound(s->size, fopts.block_size))) {
+                cs = (string8){ out_map.data, frame_compress(perm_arena, &fopts, s->str, s->size, out_map.data) };
+                file_map_close(&out_map, cs.size);
+            } else {
+                cs = *compress(perm_arena, s, &fopts);
+                string_write(filename_out, &cs);
+            }
+
+            printf("%llu bytes -> %llu bytes (%.1f%%)\n", (unsigned long long)s->size,
+                (unsigned long long)cs.size, (1.0f - (f32)cs.size / s->size) * 100.0f);
+        }
+
+        file_map_close(&in_map, 0);
     } else if (strcmp(mode, "-d") == 0) {
-        string8* cs = string_read(perm_arena, filename_in);
-        string8* s = decompress(perm_arena, cs);
-        string_write(filename_out, s);
+        file_map in_map;
+        file_map out_map;
+        string8* cs = string_read(perm_arena, filename_in, &in_map);
+        b32 ok = false;
+
+        if (cs != NULL && frame_is_frame(cs->str, cs->size) &&
+            file_map_create(&out_map, filename_out, frame_raw_size(cs->str, cs->size))) {
+            ok = frame_decompress(perm_arena, &fopts, cs->str, cs->size, out_map.data, out_map.size);
+            file_map_close(&out_map, out_map.size);
+            if (!ok) { remove(filename_out); }
+        } else {
+            string8* s = decompress(perm_arena, cs, &fopts);
+            if (s != NULL) {
+                string_write(filename_out, s);
+                ok = true;
+            }
+        }
+
+        if (!ok) { printf("Not a compressed file: %s\n", filename_in); }
+
+        file_map_close(&in_map, 0);
     } else if (strcmp(mode, "-t") == 0 ) {
-        string8* s1 = string_read(perm_arena, filename_in);
-        string8* cs1 = compress(perm_arena, s1);
+        string8* s1 = string_read(perm_arena, filename_in, NULL);
+        u64 t0 = timer_now_ns();
+        string8* cs1 = compress(perm_arena, s1, &fopts);
+        u64 t1 = timer_now_ns();
         string_write(filename_out, cs1);
-        string8* cs2 = string_read(perm_arena, filename_out);
-        string8* s2 = decompress(perm_arena, cs2);
-        string_write(filename_out, s2);
+        string8* cs2 = string_read(perm_arena, filename_out, NULL);
+        u64 t2 = timer_now_ns();
+        string8* s2 = decompress(perm_arena, cs2, &fopts);
+        u64 t3 = timer_now_ns();
+
+        printf("Threads:    %u\n", thread_pool_size(pool));
+        printf("Compress:   %.1f MB/s\n", timer_mb_per_sec(s1->size, t1 - t0));
+
+        if (s2 != NULL) {
+            string_write(filename_out, s2);
+            printf("Decompress: %.1f MB/s\n", timer_mb_per_sec(s2->size, t3 - t2));
+        }
 
-        if (s1->size == s2->size && memcmp(s1->str, s2->str, s1->size) == 0) {
+        if (s2 != NULL && s1->size == s2->size && memcmp(s1->str, s2->str, s1->size) == 0) {
             printf("Passed\n");
         } else {
             printf("Failed (Size mismatch or data corruption)\n");
         }
+    } else if (strcmp(mode, "-bh") == 0) {
+        string8* s = string_read(perm_arena, filename_in, NULL);
+        if (s == NULL) {
+            printf("Could not read: %s\n", filename_in);
+        } else {
+            bench_huffman(perm_arena, s, opts.block_size);
+            bench_histogram(perm_arena, pool, s);
+        }
+    } else if (strcmp(mode, "-bc") == 0) {
+        string8* s = string_read(perm_arena, filename_in, NULL);
+        if (s == NULL) {
+            printf("Could not read: %s\n", filename_in);
+        } else {
+            bench_codecs(perm_arena, s, &fopts);
+            bench_checksum(perm_arena, s, &fopts);
+        }
+    } else if (strcmp(mode, "-bm") == 0) {
+        string8* s = string_read(perm_arena, filename_in, NULL);
+        if (s == NULL || s->size < KiB(64)) {
+            printf("Need at least 64 KiB of input: %s\n", filename_in);
+        } else {
+            bench_messages(perm_arena, s, &fopts);
+        }
+    } else if (strcmp(mode, "-dr") == 0) {
+        // Like -sd, the decoded range goes to stdout and errors to stderr
+        FILE* in = fopen(filename_in, "rb");
+
+#if defined(_WIN32)
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+        b32 ok = in != NULL;
+        if (ok && opts.tail_size > 0) {
+            ok = stream_decompress_tail(perm_arena, &fopts, in, opts.tail_size, stdout);
+        } else if (ok) {
+            ok = stream_decompress_range(perm_arena, &fopts, in, opts.range_start, opts.range_end, stdout);
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Range decode failed: %s\n", filename_in);
+            exit_code = 1;
+        }
+
+        if (in != NULL) { fclose(in); }
+    } else if (strcmp(mode, "-a") == 0) {
+        // Appends stdin to the frame named by the input, creating it first
+        // if needed
+        FILE* frame = fopen(filename_in, "r+b");
+        if (frame == NULL) { frame = fopen(filename_in, "w+b"); }
+
+#if defined(_WIN32)
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+
+        if (frame == NULL || !stream_append(perm_arena, &fopts, stdin, frame)) {
+            fprintf(stderr, "Append failed: %s\n", filename_in);
+            exit_code = 1;
+        }
+
+        if (frame != NULL) { fclose(frame); }
+    } else if (strcmp(mode, "-sc") == 0 || strcmp(mode, "-sd") == 0) {
+        // stdout carries the data, so only errors are reported, on stderr
+        FILE* in = strcmp(filename_in, "-") == 0 ? stdin : fopen(filename_in, "rb");
+
+#if defined(_WIN32)
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+        b32 ok = false;
+        if (in != NULL && mode[2] == 'c') {
+            ok = stream_compress(perm_arena, &fopts, in, stdout);
+        } else if (in != NULL) {
+            ok = stream_decompress(perm_arena, &fopts, in, stdout);
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Stream failed: %s\n", filename_in);
+            exit_code = 1;
+        }
+
+        if (in != NULL && in != stdin) { fclose(in); }
+    } else if (strcmp(mode, "-ac") == 0 || strcmp(mode, "-ax") == 0) {
+        // -ac writes the archive named first, -ax extracts into a directory
+        // named after the archive without its extension
+        archive_stats stats = { 0 };
+        b32 ok;
+
+        if (mode[2] == 'c') {
+            ok = first_option > 3 &&
+                archive_create(perm_arena, &fopts, argv + 3, (u32)(first_option - 3), filename_in, &stats);
+        } else {
+            ok = archive_extract(perm_arena, &fopts, filename_in, filename_out, &stats);
+        }
+
+        if (ok) {
+            printf("%llu files, %llu bytes in %llu chunks, %llu unique (%llu bytes) -> %llu bytes (%.1f%%)\n",
+                (unsigned long long)stats.num_files, (unsigned long long)stats.raw_size,
+                (unsigned long long)stats.num_chunks, (unsigned long long)stats.num_unique,
+                (unsigned long long)stats.unique_size, (unsigned long long)stats.archive_size,
+                (1.0f - (f32)stats.archive_size / MAX(stats.raw_size, 1)) * 100.0f);
+        } else {
+            printf("Archive failed: %s (inputs must be readable files with relative paths)\n", filename_in);
+            exit_code = 1;
+        }
     } else {
         printf("Unknown mode: %s\n", mode);
     }
 
+    thread_pool_destroy(pool);
     arena_destroy(perm_arena);
 
-    return 0;
+    return exit_code;
 }
 
 b32 extract_args(
@@ -153,6 +361,11 @@ b32 extract_args(
     if (strcmp(*mode, "-c") == 0) { new_ext = ".gz"; }
     else if (strcmp(*mode, "-d") == 0) { new_ext = ".txt"; }
     else if (strcmp(*mode, "-t") == 0) { new_ext = ".gz"; }
+    else if (strcmp(*mode, "-sc") == 0 || strcmp(*mode, "-sd") == 0) { new_ext = ""; }
+    else if (strcmp(*mode, "-dr") == 0 || strcmp(*mode, "-a") == 0) { new_ext = ""; }
+    else if (strcmp(*mode, "-bh") == 0 || strcmp(*mode, "-bc") == 0) { new_ext = ""; }
+    else if (strcmp(*mode, "-bm") == 0) { new_ext = ""; }
+    else if (strcmp(*mode, "-ac") == 0 || strcmp(*mode, "-ax") == 0) { new_ext = ""; }
     else { return false; }
 
     char* last_dot = strrchr(*filename_in, '.');
@@ -167,7 +380,84 @@ b32 extract_args(
     return true;
 }
 
-string8* string_read(mem_arena* arena, const char* filename) {
+// Options follow the input file: -j <threads>, -B <block size in KiB>,
+// -lz to run blocks through LZ77 before Huffman coding, -1 to -9 to do
+// the same at a given level (fastest to smallest), -x4 to code Huffman
+// blocks as 4 interleaved streams, -e <huff|fse|auto> to pick the coder
+// for blocks that are not LZ coded, -cm for the context mixing coder,
+// -bwt for the Burrows-Wheeler coder, -crc to add block and frame
+// checksums, -ldm for long distance matching across the whole input and
+// -ldm-log <n> to size its table to 2^n entries, -R <start> <end> for
+// the byte range -dr decodes, -tail <n> to have it decode the last n
+// bytes instead and -v [json|csv] for per-stage statistics of -c and -d.
+// They start at argv[first].
+b32 extract_options(int argc, char** argv, i32 first, options* opts) {
+    for (i32 i = first; i < argc; i++) {
+        char* arg = argv[i];
+        char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "-j") == 0 && value != NULL) {
+            opts->num_threads = (u32)MAX(atoi(value), 1);
+            i++;
+        } else if (strcmp(arg, "-B") == 0 && value != NULL) {
+            opts->block_size = KiB(MAX(atoi(value), 1));
+            i++;
+        } else if (strcmp(arg, "-lz") == 0) {
+            opts->codec = FRAME_CODEC_LZ;
+        } else if (arg[0] == '-' && arg[1] >= '1' && arg[1] <= '9' && arg[2] == '\0') {
+            opts->codec = FRAME_CODEC_LZ;
+            opts->level = (u32)(arg[1] - '0');
+        } else if (strcmp(arg, "-R") == 0 && i + 2 < argc) {
+            opts->range_start = strtoull(argv[i + 1], NULL, 10);
+            opts->range_end = strtoull(argv[i + 2], NULL, 10);
+            if (opts->range_start > opts->range_end) { return false; }
+            i += 2;
+        } else if (strcmp(arg, "-v") == 0) {
+            opts->stats = STATS_TEXT;
+            if (value != NULL && strcmp(value, "json") == 0) { opts->stats = STATS_JSON; i++; }
+            else if (value != NULL && strcmp(value, "csv") == 0) { opts->stats = STATS_CSV; i++; }
+        } else if (strcmp(arg, "-tail") == 0 && value != NULL) {
+            opts->tail_size = strtoull(value, NULL, 10);
+            i++;
+        } else if (strcmp(arg, "-ldm") == 0) {
+            opts->ldm_table_log = LDM_DEFAULT_TABLE_LOG;
+        } else if (strcmp(arg, "-ldm-log") == 0 && value != NULL) {
+            opts->ldm_table_log = (u32)CLAMP(atoi(value), LDM_MIN_TABLE_LOG, LDM_MAX_TABLE_LOG);
+            i++;
+        } else if (strcmp(arg, "-crc") == 0) {
+            opts->checksum = true;
+        } else if (strcmp(arg, "-cm") == 0) {
+            opts->codec = FRAME_CODEC_CM;
+        } else if (strcmp(arg, "-bwt") == 0) {
+            opts->codec = FRAME_CODEC_BWT;
+        } else if (strcmp(arg, "-x4") == 0) {
+            opts->interleaved = true;
+        } else if (strcmp(arg, "-e") == 0 && value != NULL) {
+            if (strcmp(value, "huff") == 0) { opts->entropy = FRAME_ENTROPY_HUFF; }
+            else if (strcmp(value, "fse") == 0) { opts->entropy = FRAME_ENTROPY_FSE; }
+            else if (strcmp(value, "auto") == 0) { opts->entropy = FRAME_ENTROPY_AUTO; }
+            else { return false; }
+            i++;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// With a map the file is mapped instead of copied into the arena when it
+// can be, the string then lives until the map is closed. Anything that
+// cannot be mapped, such as a pipe, is read with stdio and leaves the map
+// zeroed.
+string8* string_read(mem_arena* arena, const char* filename, file_map* map) {
+    if (map != NULL && file_map_open(map, filename)) {
+        string8* s = PUSH_STRUCT(arena, string8);
+        s->str = map->data;
+        s->size = map->size;
+        return s;
+    }
+
     FILE* f = fopen(filename, "rb");
     if (f == NULL) { return NULL; }
 
@@ -203,212 +493,380 @@ void string_write(const char* filename, string8* s) {
     fclose(f);
 }
 
-string8* compress(mem_arena* arena, string8* s) {
-    u32 counts[ASCII_UNIQUE] = {0};
-    for (u64 i = 0; i < s->size; i++) { counts[s->str[i]]++; }
+string8* compress(mem_arena* arena, string8* s, frame_options* opts) {
+    string8* result = PUSH_STRUCT(arena, string8);
+    result->str = PUSH_ARRAY_NZ(arena, u8, frame_bound(s->size, opts->block_size));
+    result->size = frame_compress(arena, opts, s->str, s->size, result->str);
 
-    min_heap* heap = heapify(arena, counts, ASCII_UNIQUE);
-    huff_node* root = treeify(arena, heap);
+    return result;
+}
 
-    code_table* table = PUSH_STRUCT(arena, code_table);
-    table->codes = PUSH_ARRAY(arena, code, ASCII_UNIQUE);
-    memset(table->codes, 0, sizeof(code) * ASCII_UNIQUE);
+string8* decompress(mem_arena* arena, string8* s, frame_options* opts) {
+    if (s == NULL) { return NULL; }
 
-    char path_buffer[ASCII_UNIQUE];
-    generate_codes(arena, table, root, path_buffer, 0);
+    string8* result = PUSH_STRUCT(arena, string8);
 
-    header_write_buffer hb = write_header(arena, s->size, counts);
+    if (frame_is_frame(s->str, s->size)) {
+        result->size = frame_raw_size(s->str, s->size);
+        result->str = PUSH_ARRAY_NZ(arena, u8, result->size);
 
-    bit_writer bw = {0};
-    bw.data = hb.data_start;
-    bw.data[0] = 0;
+        if (!frame_decompress(arena, opts, s->str, s->size, result->str, result->size)) {
+            return NULL;
+        }
 
-    for (u64 i = 0; i < s->size; i++) {
-        write_bits(&bw, &table->codes[s->str[i]].bits);
+        return result;
     }
 
-    u64 bit_data_len = bw.byte_idx + (bw.bit_idx > 0 ? 1 : 0);
-    
-    string8* result = PUSH_STRUCT(arena, string8);
-    result->str = hb.file_start;
-    result->size = (u64)(hb.data_start - hb.file_start) + bit_data_len;
+    header_read_buffer hb = read_header(arena, s);
+    if (hb.table == NULL) { return NULL; }
+
+    bit_reader br;
+    bit_reader_init(&br, hb.data_start, s->size - (u64)(hb.data_start - s->str));
+
+    result->size = hb.original_size;
+    result->str = PUSH_ARRAY_NZ(arena, u8, result->size);
+
+    huff_decode(hb.table, &br, result->str, result->size);
 
     return result;
 }
 
-string8* decompress(mem_arena* arena, string8* s) {
-    header_read_buffer hb = read_header(arena, s);
+// Old files carry the symbol counts and need the tree rebuilt,
+// new ones carry only the canonical code lengths.
+header_read_buffer read_header(mem_arena* arena, string8* s) {
+    header_read_buffer hb = { 0 };
+    if (s == NULL || s->size < sizeof(u32)) { return hb; }
 
-    bit_reader br = {0};
-    br.data = hb.data_start;
-    string8* result = PUSH_STRUCT(arena, string8);
-    result->size = hb.original_size;
-    result->str = PUSH_ARRAY(arena, u8, result->size);
+    u8* cursor = s->str;
+    u8* end = s->str + s->size;
+    u32 magic = *(u32*)cursor;
 
-    for (u64 i = 0; i < result->size; i++) {
-        huff_node* node = hb.root;
+    if (magic == HEADER_MAGIC) {
+        if (s->size < sizeof(huff_header)) { return hb; }
 
-        while (node->left != NULL || node->right != NULL) {
-            u8 bit = read_bit(&br);
-            node = (bit == 0) ? node->left : node->right;
+        huff_header* header = (huff_header*)cursor;
+        cursor += sizeof(huff_header);
+        if ((u64)(end - cursor) < (u64)header->unique_chars * 5) { return hb; }
+
+        u32 counts[ASCII_UNIQUE] = {0};
+        for (u16 i = 0; i < header->unique_chars; i++) {
+            u8 character = *cursor;
+            cursor++;
+            u32 count = *(u32*)cursor;
+            cursor += sizeof(u32);
+
+            counts[character] = count;
         }
 
-        result->str[i] = node->value;
+        min_heap* heap = heapify(arena, counts, ASCII_UNIQUE);
+        huff_node* root = treeify(arena, heap);
+
+        hb.table = huff_decode_table_from_tree(arena, root);
+        hb.original_size = header->original_size;
+        hb.data_start = cursor;
+    } else if (magic == HEADER_MAGIC_V2) {
+        if (s->size < sizeof(huff_header_v2)) { return hb; }
+
+        huff_header_v2* header = (huff_header_v2*)cursor;
+        cursor += sizeof(huff_header_v2);
+
+        u8 lengths[ASCII_UNIQUE];
+        cursor = huff_read_lengths(cursor, end, lengths);
+        if (cursor == NULL) { return hb; }
+
+        hb.original_size = header->original_size;
+        hb.table = huff_decode_table_from_lengths(arena, lengths, hb.original_size);
+        hb.data_start = cursor;
     }
 
-    return result;
+    return hb;
 }
 
-header_write_buffer write_header(mem_arena* arena, u64 original_size, u32* counts) {
-    u16 unique_count = 0;
-    for (int i = 0; i < ASCII_UNIQUE; i++) {
-        if (counts[i] > 0) { unique_count++; }
+// -c and -d with -v. Input and output go through stdio instead of being
+// mapped, so reading and writing are stages of their own rather than
+// page faults inside the coder.
+b32 run_with_stats(
+    mem_arena* arena, frame_options* opts, b32 compressing,
+    const char* filename_in, const char* filename_out, stats_format format
+) {
+    run_stats stats = { .mode = compressing ? "compress" : "decompress" };
+
+    frame_times times = { 0 };
+    frame_options timed = *opts;
+    timed.times = &times;
+
+    u64 t0 = timer_now_ns();
+    string8* s = string_read(arena, filename_in, NULL);
+    u64 t1 = timer_now_ns();
+    if (s == NULL) { return false; }
+
+    string8* result = compressing ? compress(arena, s, &timed) : decompress(arena, s, &timed);
+    u64 t2 = timer_now_ns();
+    if (result == NULL) { return false; }
+
+    string_write(filename_out, result);
+    u64 t3 = timer_now_ns();
+
+    string8* raw = compressing ? s : result;
+    stats.raw_size = raw->size;
+    stats.comp_size = compressing ? result->size : s->size;
+
+    stats.ns[STAGE_READ] = t1 - t0;
+    stats.bytes[STAGE_READ] = s->size;
+    stats.ns[STAGE_FRAME] = t2 - t1;
+    stats.bytes[STAGE_FRAME] = raw->size;
+    stats.ns[STAGE_WRITE] = t3 - t2;
+    stats.bytes[STAGE_WRITE] = result->size;
+
+    stats.peak_arena = arena->peak_pos - ARENA_BASE_POS;
+    stats.peak_worker_arena = thread_pool_peak_arena(opts->pool);
+    stats_add_frame_times(&stats, &times);
+
+    if (format == STATS_TEXT) {
+        printf("%llu bytes -> %llu bytes (%.1f%%)\n",
+            (unsigned long long)s->size, (unsigned long long)result->size,
+            (1.0f - (f32)stats.comp_size / MAX(stats.raw_size, 1)) * 100.0f);
     }
+    stats_print(&stats, format, stdout);
 
-    u64 header_full_size = sizeof(huff_header) + (unique_count * 5);
-    u8* buffer = PUSH_ARRAY(arena, u8, header_full_size + original_size);
+    return true;
+}
 
-    huff_header* header = (huff_header*)buffer;
-    header->magic = HEADER_MAGIC;
-    header->original_size = original_size;
-    header->unique_chars = unique_count;
+#define BENCH_ROUNDS 5
 
-    u8* cursor = buffer + sizeof(huff_header);
+// Codes the input as Huffman blocks with the single and the 4-stream
+// layout and times decoding them on one thread, best of BENCH_ROUNDS
+void bench_huffman(mem_arena* arena, string8* s, u64 block_size) {
+    mem_arena_temp temp = arena_temp_begin(arena);
 
-    for (int i = 0; i < ASCII_UNIQUE; i++) {
-        if (counts[i] > 0) {
-            *cursor++ = (u8)i;
-            *(u32*)cursor = counts[i];
-            cursor += sizeof(u32);
-        }
-    }
+    block_size = frame_block_size(block_size);
+    u64 num_blocks = (s->size + block_size - 1) / block_size;
+    u64 slot_size = HUFF_BLOCK_BOUND(block_size);
 
-    return (header_write_buffer){ .file_start = buffer, .data_start = cursor };
-}
+    u8* comp = PUSH_ARRAY_NZ(arena, u8, num_blocks * slot_size);
+    u64* comp_sizes = PUSH_ARRAY(arena, u64, num_blocks);
+    u8* out = PUSH_ARRAY_NZ(arena, u8, s->size);
 
-header_read_buffer read_header(mem_arena* arena, string8* s) {
-    u8* cursor = s->str;
+    const char* names[2] = { "Single:  ", "4-stream:" };
 
-    huff_header* header = (huff_header*)cursor;
-    cursor += sizeof(huff_header);
+    for (u32 layout = 0; layout < 2; layout++) {
+        u64 total_size = 0;
 
-    u32 counts[ASCII_UNIQUE] = {0};
-    for (u16 i = 0; i < header->unique_chars; i++) {
-        u8 character = *cursor;
-        cursor++;
-        u32 count = *(u32*)cursor;
-        cursor += sizeof(u32);
+        for (u64 i = 0; i < num_blocks; i++) {
+            u8* in = s->str + i * block_size;
+            u64 size = MIN(block_size, s->size - i * block_size);
+            u8* dst = comp + i * slot_size;
 
-        counts[character] = count;
-    }
+            u32 counts[HUFF_SYMBOLS];
+            hist_count(in, size, counts);
 
-    min_heap* heap = heapify(arena, counts, ASCII_UNIQUE);
-    huff_node* root = treeify(arena, heap);
+            comp_sizes[i] = layout == 0 ?
+                huff_compress_block(arena, in, size, counts, dst, NULL) :
+                huff_compress_block_x4(arena, in, size, counts, dst, NULL);
+            total_size += comp_sizes[i];
+        }
 
-    return (header_read_buffer) {
-        .root = root,
-        .original_size = header->original_size,
-        .data_start = cursor
-    };
-}
+        u64 best = UINT64_MAX;
+        b32 ok = true;
 
-void generate_codes(
-    mem_arena* arena, code_table* table,
-    huff_node* node, char* path, i32 depth
-) {
-    if (node == NULL) { return; }
+        for (u32 round = 0; round < BENCH_ROUNDS; round++) {
+            u64 t0 = timer_now_ns();
 
-    if (node->left == NULL && node->right == NULL) {
-        table->codes[node->value].bits.size = depth;
+            for (u64 i = 0; i < num_blocks; i++) {
+                u8* src = comp + i * slot_size;
+                u8* dst = out + i * block_size;
+                u64 size = MIN(block_size, s->size - i * block_size);
 
-        u8* str = PUSH_ARRAY(arena, u8, depth);
-        memcpy(str, path, depth);
-        table->codes[node->value].bits.str = str;
+                mem_arena_temp block_temp = arena_temp_begin(arena);
+                ok = ok && (layout == 0 ?
+                    huff_decompress_block(arena, src, comp_sizes[i], dst, size) :
+                    huff_decompress_block_x4(arena, src, comp_sizes[i], dst, size));
+                arena_temp_end(block_temp);
+            }
 
-        return;
-    }
+            best = MIN(best, timer_now_ns() - t0);
+        }
 
-    path[depth] = '0';
-    generate_codes(arena, table, node->left, path, depth + 1);
+        ok = ok && memcmp(out, s->str, s->size) == 0;
+        printf("%s %.1f MB/s, %llu bytes%s\n", names[layout],
+            timer_mb_per_sec(s->size, best), (unsigned long long)total_size, ok ? "" : " (Failed)");
+    }
 
-    path[depth] = '1';
-    generate_codes(arena, table, node->right, path, depth + 1);
+    arena_temp_end(temp);
 }
 
-void write_bits(bit_writer* bw, string8* bits) {
-    for (u64 i = 0; i < bits->size; i++) {
-        if (bits->str[i] == '1') {
-            bw->data[bw->byte_idx] |= (1 << (7 - bw->bit_idx));
+// Times counting the whole input with a single table, with the
+// interleaved tables on one thread and split over the thread pool
+void bench_histogram(mem_arena* arena, thread_pool* pool, string8* s) {
+    const char* names[3] = { "Histogram 1 table: ", "Histogram 8 tables:", "Histogram parallel:" };
+    u64 expected[HIST_SYMBOLS];
+
+    for (u32 variant = 0; variant < 3; variant++) {
+        u64 counts[HIST_SYMBOLS];
+        u64 best = UINT64_MAX;
+
+        for (u32 round = 0; round < BENCH_ROUNDS; round++) {
+            u64 t0 = timer_now_ns();
+
+            if (variant == 0) {
+                memset(counts, 0, sizeof(counts));
+                for (u64 i = 0; i < s->size; i++) { counts[s->str[i]]++; }
+            } else if (variant == 1) {
+                u32 partial[HIST_SYMBOLS];
+                memset(counts, 0, sizeof(counts));
+
+                for (u64 offset = 0; offset < s->size; offset += HIST_MAX_CHUNK) {
+                    hist_count(s->str + offset, MIN(HIST_MAX_CHUNK, s->size - offset), partial);
+                    for (u32 c = 0; c < HIST_SYMBOLS; c++) { counts[c] += partial[c]; }
+                }
+            } else {
+                hist_count_parallel(arena, pool, s->str, s->size, counts);
+            }
+
+            best = MIN(best, timer_now_ns() - t0);
         }
-        
-        bw->bit_idx++;
 
-        if (bw->bit_idx == 8) {
-            bw->bit_idx = 0;
-            bw->data[++bw->byte_idx] = 0;
-        }
+        if (variant == 0) { memcpy(expected, counts, sizeof(counts)); }
+        b32 ok = memcmp(expected, counts, sizeof(counts)) == 0;
+
+        printf("%s %.1f MB/s%s\n", names[variant],
+            timer_mb_per_sec(s->size, best), ok ? "" : " (Failed)");
     }
 }
 
-u8 read_bit(bit_reader* br) {
-    u8 byte = br->data[br->byte_idx];
-    u8 bit = (byte >> (7 - br->bit_idx)) & 1;
+// Runs the input through every codec once with the given block size and
+// thread pool, reporting ratio and throughput both ways
+void bench_codecs(mem_arena* arena, string8* s, frame_options* base) {
+    typedef struct {
+        const char* name;
+        frame_codec codec;
+        u32 level;
+        frame_entropy entropy;
+        b32 interleaved;
+    } bench_config;
+
+    static const bench_config configs[] = {
+        { "huff   ", FRAME_CODEC_HUFF, 0, FRAME_ENTROPY_HUFF, false },
+        { "huff-x4", FRAME_CODEC_HUFF, 0, FRAME_ENTROPY_HUFF, true },
+        { "fse    ", FRAME_CODEC_HUFF, 0, FRAME_ENTROPY_FSE, false },
+        { "lz -1  ", FRAME_CODEC_LZ, 1, FRAME_ENTROPY_HUFF, false },
+        { "lz -6  ", FRAME_CODEC_LZ, 6, FRAME_ENTROPY_HUFF, false },
+        { "lz -9  ", FRAME_CODEC_LZ, 9, FRAME_ENTROPY_HUFF, false },
+        { "cm     ", FRAME_CODEC_CM, 0, FRAME_ENTROPY_HUFF, false },
+        { "bwt    ", FRAME_CODEC_BWT, 0, FRAME_ENTROPY_HUFF, false }
+    };
 
-    br->bit_idx++;
-    if (br->bit_idx == 8) {
-        br->bit_idx = 0;
-        br->byte_idx++;
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    u8* comp = PUSH_ARRAY_NZ(arena, u8, frame_bound(s->size, base->block_size));
+    u8* out = PUSH_ARRAY_NZ(arena, u8, s->size);
+
+    for (u32 i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        frame_options opts = *base;
+        opts.codec = configs[i].codec;
+        opts.level = configs[i].level;
+        opts.entropy = configs[i].entropy;
+        opts.interleaved = configs[i].interleaved;
+
+        u64 t0 = timer_now_ns();
+        u64 comp_size = frame_compress(arena, &opts, s->str, s->size, comp);
+        u64 t1 = timer_now_ns();
+        b32 ok = frame_decompress(arena, &opts, comp, comp_size, out, s->size);
+        u64 t2 = timer_now_ns();
+
+        ok = ok && memcmp(out, s->str, s->size) == 0;
+        printf("%s %10llu bytes, ratio %.3f, %7.1f MB/s compress, %7.1f MB/s decompress%s\n",
+            configs[i].name, (unsigned long long)comp_size,
+            s->size ? (f64)s->size / (f64)comp_size : 0.0,
+            timer_mb_per_sec(s->size, t1 - t0), timer_mb_per_sec(s->size, t2 - t1),
+            ok ? "" : " (Failed)");
     }
-    return bit;
+
+    arena_temp_end(temp);
 }
 
-token find_longest_match(u8* data, u64 current_pos, u64 window_size, u64 lookahead_size, u64 total_size) {
-    token match = {0, 0, data[current_pos]};
+// Decodes the input compressed with the given options, with and without
+// checksums, and reports what verifying them costs. Best of BENCH_ROUNDS.
+void bench_checksum(mem_arena* arena, string8* s, frame_options* base) {
+    mem_arena_temp temp = arena_temp_begin(arena);
 
-    u64 search_start = (current_pos > window_size) ? current_pos - window_size : 0;
+    u8* comp = PUSH_ARRAY_NZ(arena, u8, frame_bound(s->size, base->block_size));
+    u8* out = PUSH_ARRAY_NZ(arena, u8, s->size);
+    u64 best[2] = { UINT64_MAX, UINT64_MAX };
+    b32 ok = true;
 
-    for (u64 i = search_start; i < current_pos; i++) {
-        u64 len = 0;
-        while (len < lookahead_size && 
-               (current_pos + len) < total_size && 
-               data[i + len] == data[current_pos + len]) {
-            len++;
-        }
+    for (u32 checked = 0; checked < 2; checked++) {
+        frame_options opts = *base;
+        opts.checksum = checked;
 
-        if (len >= match.length) {
-            match.offset = (u16)(current_pos - i);
-            match.length = (u16)len;
-            match.next_char = data[current_pos + len];
+        u64 comp_size = frame_compress(arena, &opts, s->str, s->size, comp);
+
+        for (u32 round = 0; round < BENCH_ROUNDS; round++) {
+            u64 t0 = timer_now_ns();
+            ok = ok && frame_decompress(arena, &opts, comp, comp_size, out, s->size);
+            best[checked] = MIN(best[checked], timer_now_ns() - t0);
         }
     }
 
-    return match;
+    u64 t0 = timer_now_ns();
+    u32 crc = crc32c(0, s->str, s->size);
+    u64 crc_time = timer_now_ns() - t0;
+
+    ok = ok && memcmp(out, s->str, s->size) == 0;
+    printf("Checksum:  CRC32C %.1f MB/s (%08x), decode %.1f -> %.1f MB/s, %+.1f%%%s\n",
+        timer_mb_per_sec(s->size, crc_time), crc,
+        timer_mb_per_sec(s->size, best[0]), timer_mb_per_sec(s->size, best[1]),
+        best[0] ? 100.0 * ((f64)best[1] - (f64)best[0]) / (f64)best[0] : 0.0,
+        ok ? "" : " (Failed)");
+
+    arena_temp_end(temp);
 }
 
-string8* lz_compress(mem_arena* arena, string8* s) {
-    u8* out_buffer = PUSH_ARRAY(arena, u8, s->size * 2);
-    u8* cursor = out_buffer;
-
-    u64 pos = 0;
-    while (pos < s->size) {
-        token match = find_longest_match(s->str, pos, 4096, 255, s->size);
-
-        if (match.length > 3) {
-            *cursor++ = 1;
-            *(u16*)cursor = match.offset;
-            cursor += 2;
-            *(u16*)cursor = match.length;
-            cursor += 2;
-            pos += match.length;
-        } else {
-            *cursor++ = 0;
-            *cursor++ = s->str[pos];
-            pos++;
+#define BENCH_MESSAGE_BYTES MiB(16)
+
+// Cuts the input into messages of 1 to 64 KiB and runs them one by one
+// through a warm single threaded huff_ctx, the way a service handling
+// small requests would
+void bench_messages(mem_arena* arena, string8* s, frame_options* base) {
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    huff_ctx* ctx = huff_ctx_create(base, 1);
+    u8* comp = PUSH_ARRAY_NZ(arena, u8, huff_ctx_bound(ctx, KiB(64)));
+    u8* out = PUSH_ARRAY_NZ(arena, u8, KiB(64));
+
+    for (u64 size = KiB(1); size <= KiB(64); size *= 2) {
+        u64 num_messages = BENCH_MESSAGE_BYTES / size;
+        u64 num_slices = s->size / size;
+        u64 total_comp = 0;
+        u64 comp_time = 0;
+        u64 decomp_time = 0;
+        b32 ok = true;
+
+        for (u64 i = 0; i < num_messages && ok; i++) {
+            u8* msg = s->str + (i % num_slices) * size;
+
+            u64 t0 = timer_now_ns();
+            u64 comp_size = huff_ctx_compress(ctx, msg, size, comp, huff_ctx_bound(ctx, size));
+            u64 t1 = timer_now_ns();
+
+            u64 out_size = 0;
+            ok = huff_ctx_decompress(ctx, comp, comp_size, out, KiB(64), &out_size);
+            u64 t2 = timer_now_ns();
+
+            ok = ok && out_size == size && memcmp(out, msg, size) == 0;
+            total_comp += comp_size;
+            comp_time += t1 - t0;
+            decomp_time += t2 - t1;
         }
+
+        u64 total = num_messages * size;
+        printf("%3llu KiB: ratio %.3f, compress %8.0f msg/s %7.1f MB/s, decompress %8.0f msg/s %7.1f MB/s%s\n",
+            (unsigned long long)(size / KiB(1)), (f64)total / (f64)total_comp,
+            (f64)num_messages * 1e9 / (f64)comp_time, timer_mb_per_sec(total, comp_time),
+            (f64)num_messages * 1e9 / (f64)decomp_time, timer_mb_per_sec(total, decomp_time),
+            ok ? "" : " (Failed)");
     }
 
-    string8* result = PUSH_STRUCT(arena, string8);
-    result->str = out_buffer;
-    result->size = (u64)(cursor - out_buffer);
-    return result;
+    huff_ctx_destroy(ctx);
+    arena_temp_end(temp);
 }
@@ -0,0 +1,157 @@
+#include "mapfile.h"
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+b32 file_map_open(file_map* map, const char* filename) {
+    *map = (file_map){ 0 };
+
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) { return false; }
+
+    LARGE_INTEGER size;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    // The view keeps the mapping and the file open after the handles close
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) { return false; }
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == NULL) { return false; }
+
+    map->data = (u8*)data;
+    map->size = (u64)size.QuadPart;
+    map->handle = -1;
+
+    return true;
+}
+
+b32 file_map_create(file_map* map, const char* filename, u64 size) {
+    *map = (file_map){ 0 };
+
+    HANDLE file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) { return false; }
+
+    map->size = size;
+    map->handle = (i64)(intptr_t)file;
+    if (size == 0) { return true; }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE,
+        (DWORD)(size >> 32), (DWORD)size, NULL);
+    void* data = mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0) : NULL;
+    if (mapping != NULL) { CloseHandle(mapping); }
+
+    if (data == NULL) {
+        CloseHandle(file);
+        DeleteFileA(filename);
+        *map = (file_map){ 0 };
+        return false;
+    }
+
+    map->data = (u8*)data;
+
+    return true;
+}
+
+b32 file_map_close(file_map* map, u64 final_size) {
+    b32 ok = true;
+
+    if (map->data != NULL) { UnmapViewOfFile(map->data); }
+
+    // The file can only shrink once no view of it is left
+    if (map->handle != 0 && map->handle != -1) {
+        HANDLE file = (HANDLE)(intptr_t)map->handle;
+        LARGE_INTEGER end = { .QuadPart = (LONGLONG)final_size };
+        ok = SetFilePointerEx(file, end, NULL, FILE_BEGIN) && SetEndOfFile(file);
+        CloseHandle(file);
+    }
+
+    *map = (file_map){ 0 };
+
+    return ok;
+}
+
+#elif defined(__linux__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+b32 file_map_open(file_map* map, const char* filename) {
+    *map = (file_map){ 0 };
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) { return false; }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    // The mapping keeps the file open after the descriptor closes
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) { return false; }
+
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    map->data = (u8*)data;
+    map->size = (u64)st.st_size;
+    map->handle = -1;
+
+    return true;
+}
+
+b32 file_map_create(file_map* map, const char* filename, u64 size) {
+    *map = (file_map){ 0 };
+
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) { return false; }
+
+    map->size = size;
+    map->handle = fd;
+    if (size == 0) { return true; }
+
+    void* data = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        data = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    if (data == MAP_FAILED) {
+        close(fd);
+        unlink(filename);
+        *map = (file_map){ 0 };
+        return false;
+    }
+
+    map->data = (u8*)data;
+
+    return true;
+}
+
+b32 file_map_close(file_map* map, u64 final_size) {
+    b32 ok = true;
+
+    if (map->data != NULL) { munmap(map->data, (size_t)map->size); }
+
+    if (map->handle > 0) {
+        ok = ftruncate((int)map->handle, (off_t)final_size) == 0;
+        ok = close((int)map->handle) == 0 && ok;
+    }
+
+    *map = (file_map){ 0 };
+
+    return ok;
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include "base.h"
+
+// A whole file mapped into memory, so the codec reads its input from and
+// writes its output to the page cache without a copy through stdio.
+// Only regular files can be mapped, pipes fail and need a stdio path.
+typedef struct {
+    u8* data;
+    u64 size;
+    i64 handle; // Open file of a created map: fd, or a HANDLE on Windows
+} file_map;
+
+// Maps a file read only, hinting the kernel to read ahead sequentially.
+// Fails for empty files.
+b32 file_map_open(file_map* map, const char* filename);
+
+// Creates (or truncates) a file of size bytes and maps it writable. The
+// size is an upper bound, file_map_close trims the file to what was used.
+b32 file_map_create(file_map* map, const char* filename, u64 size);
+
+// final_size is only used for created maps, false means the file could
+// not be trimmed to it. Closing a zeroed map is a no-op.
+b32 file_map_close(file_map* map, u64 final_size);
+
+#endif
@@ -1,3 +1,5 @@
+#include <stddef.h>
+
 #include "minheap.h"
 
 void swap(min_heap* heap, u64 i, u64 j) {
@@ -0,0 +1,62 @@
+#include "stats.h"
+#include "timer.h"
+
+static const char* stage_names[STAGE_COUNT] = {
+    "read", "histogram", "tree", "codes", "encode", "decode", "frame", "write"
+};
+
+void stats_add_frame_times(run_stats* stats, frame_times* times) {
+    for (u32 s = 0; s < FRAME_STEP_COUNT; s++) {
+        stats->ns[STAGE_HISTOGRAM + s] += times->ns[s];
+        stats->bytes[STAGE_HISTOGRAM + s] += times->bytes[s];
+    }
+}
+
+void stats_print(run_stats* stats, stats_format format, FILE* out) {
+    f64 bits_per_symbol = stats->raw_size > 0 ? (f64)stats->comp_size * 8.0 / (f64)stats->raw_size : 0.0;
+
+    if (format == STATS_JSON) {
+        fprintf(out, "{\"mode\":\"%s\",\"raw_bytes\":%llu,\"comp_bytes\":%llu,\"bits_per_symbol\":%.4f,"
+            "\"peak_arena\":%llu,\"peak_worker_arena\":%llu,\"stages\":{",
+            stats->mode, (unsigned long long)stats->raw_size, (unsigned long long)stats->comp_size,
+            bits_per_symbol, (unsigned long long)stats->peak_arena, (unsigned long long)stats->peak_worker_arena);
+
+        b32 first = true;
+        for (u32 s = 0; s < STAGE_COUNT; s++) {
+            if (stats->bytes[s] == 0) { continue; }
+
+            fprintf(out, "%s\"%s\":{\"ns\":%llu,\"bytes\":%llu,\"mb_per_sec\":%.1f}",
+                first ? "" : ",", stage_names[s], (unsigned long long)stats->ns[s],
+                (unsigned long long)stats->bytes[s], timer_mb_per_sec(stats->bytes[s], stats->ns[s]));
+            first = false;
+        }
+
+        fprintf(out, "}}\n");
+    } else if (format == STATS_CSV) {
+        // Every stage has its columns, the ones that did not run are 0
+        fprintf(out, "mode,raw_bytes,comp_bytes,bits_per_symbol,peak_arena,peak_worker_arena");
+        for (u32 s = 0; s < STAGE_COUNT; s++) { fprintf(out, ",%s_ns,%s_mb_per_sec", stage_names[s], stage_names[s]); }
+
+        fprintf(out, "\n%s,%llu,%llu,%.4f,%llu,%llu", stats->mode,
+            (unsigned long long)stats->raw_size, (unsigned long long)stats->comp_size, bits_per_symbol,
+            (unsigned long long)stats->peak_arena, (unsigned long long)stats->peak_worker_arena);
+        for (u32 s = 0; s < STAGE_COUNT; s++) {
+            fprintf(out, ",%llu,%.1f", (unsigned long long)stats->ns[s],
+                timer_mb_per_sec(stats->bytes[s], stats->ns[s]));
+        }
+
+        fprintf(out, "\n");
+    } else {
+        fprintf(out, "Stage          ms       MB/s\n");
+        for (u32 s = 0; s < STAGE_COUNT; s++) {
+            if (stats->bytes[s] == 0) { continue; }
+
+            fprintf(out, "%-10s %7.2f %10.1f\n", stage_names[s], (f64)stats->ns[s] / 1e6,
+                timer_mb_per_sec(stats->bytes[s], stats->ns[s]));
+        }
+
+        fprintf(out, "Bits/symbol: %.3f\n", bits_per_symbol);
+        fprintf(out, "Peak arena:  %.1f MiB main, %.1f KiB largest worker\n",
+            (f64)stats->peak_arena / (f64)MiB(1), (f64)stats->peak_worker_arena / (f64)KiB(1));
+    }
+}
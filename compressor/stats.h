@@ -0,0 +1,51 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+#include "base.h"
+#include "arena.h"
+#include "frame.h"
+
+// Where the time of a -c or -d run goes. Reading, the frame coder and
+// writing are timed around the real calls. The stages in between are
+// the frame_times of the same run: they are timed inside the blocks and
+// summed over every worker, so they add up to more than the frame stage
+// when several threads ran.
+
+typedef enum {
+    STAGE_READ,
+    STAGE_HISTOGRAM, // Same order as frame_step
+    STAGE_TREE,
+    STAGE_CODES,
+    STAGE_ENCODE,
+    STAGE_DECODE,
+    STAGE_FRAME, // The whole frame_compress or frame_decompress call
+    STAGE_WRITE,
+    STAGE_COUNT
+} stats_stage;
+
+typedef enum {
+    STATS_NONE,
+    STATS_TEXT,
+    STATS_JSON,
+    STATS_CSV
+} stats_format;
+
+typedef struct {
+    const char* mode;
+    u64 ns[STAGE_COUNT];
+    u64 bytes[STAGE_COUNT]; // Input of the stage, a stage that did not run has none
+
+    u64 raw_size;
+    u64 comp_size;
+    u64 peak_arena; // High-water marks past the arena headers
+    u64 peak_worker_arena; // The largest over all workers
+} run_stats;
+
+void stats_add_frame_times(run_stats* stats, frame_times* times);
+
+// CSV starts with a header line, JSON is a single object per run
+void stats_print(run_stats* stats, stats_format format, FILE* out);
+
+#endif
@@ -0,0 +1,662 @@
+#include <string.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "stream.h"
+
+static u64 read_full(FILE* f, u8* buffer, u64 size) {
+    u64 filled = 0;
+
+    while (filled < size) {
+        size_t n = fread(buffer + filled, 1, size - filled, f);
+        if (n == 0) { break; }
+        filled += n;
+    }
+
+    return filled;
+}
+
+static b32 write_full(FILE* f, void* buffer, u64 size) {
+    return fwrite(buffer, 1, size, f) == size;
+}
+
+// Batch i is coded by the pool while the I/O thread writes batch i - 1
+// and reads batch i + 1, so each side alternates between two buffers. A
+// job writes first, the reader then has a whole batch of coding to hide
+// behind.
+typedef struct {
+    FILE* in;
+    FILE* out;
+    b32 ok;
+
+    u8* read_buffer; // NULL once the input is exhausted
+    u64 read_size;
+    u64 filled;
+
+    u8* slots;
+    u64 slot_size;
+    u64* comp_sizes;
+    u64 num_blocks;
+} compress_io;
+
+static void compress_io_job(void* ctx) {
+    compress_io* io = (compress_io*)ctx;
+
+    for (u64 i = 0; i < io->num_blocks && io->ok; i++) {
+        io->ok = write_full(io->out, io->slots + i * io->slot_size, io->comp_sizes[i]);
+    }
+    io->num_blocks = 0;
+
+    if (io->read_buffer != NULL) {
+        io->filled = read_full(io->in, io->read_buffer, io->read_size);
+    }
+}
+
+// Where the blocks written so far went, for writers that end with a seek
+// table. Grown by doubling.
+typedef struct {
+    frame_index_entry* entries;
+    u64 count;
+    u64 capacity;
+    u64 comp_offset; // Of the next block, from the start of the frame
+    u64 raw_offset;
+} block_list;
+
+static void block_list_add(
+    mem_arena* arena, block_list* list, u64* comp_sizes, u64 num_blocks, u64 block_size, u64 raw_size
+) {
+    if (list->count + num_blocks > list->capacity) {
+        list->capacity = MAX(list->capacity * 2, list->count + num_blocks);
+        frame_index_entry* entries = PUSH_ARRAY_NZ(arena, frame_index_entry, list->capacity);
+        if (list->count > 0) { memcpy(entries, list->entries, list->count * sizeof(frame_index_entry)); }
+        list->entries = entries;
+    }
+
+    for (u64 i = 0; i < num_blocks; i++) {
+        list->entries[list->count].raw_offset = list->raw_offset;
+        list->entries[list->count].comp_offset = list->comp_offset;
+        list->count++;
+
+        list->comp_offset += comp_sizes[i];
+        list->raw_offset += MIN(block_size, raw_size - i * block_size);
+    }
+}
+
+// Codes in until it runs out and writes the blocks to out, block headers
+// included. checksum is carried on from the value passed in. With a list
+// every block is recorded in it, which grows past the batch buffers, so
+// the caller releases the arena once it is done with the list.
+static b32 write_blocks(
+    mem_arena* arena, frame_options* opts, FILE* in, FILE* out, u32* checksum, block_list* list
+) {
+    u64 block_size = frame_block_size(opts->block_size);
+    u64 slot_size = frame_slot_size(block_size);
+    u64 batch_blocks = thread_pool_size(opts->pool);
+    u64 batch_size = batch_blocks * block_size;
+
+    u8* in_buffers[2];
+    u8* slots[2];
+    u64* comp_sizes[2];
+    for (u32 i = 0; i < 2; i++) {
+        in_buffers[i] = PUSH_ARRAY_NZ(arena, u8, batch_size);
+        slots[i] = PUSH_ARRAY_NZ(arena, u8, batch_blocks * slot_size);
+        comp_sizes[i] = PUSH_ARRAY(arena, u64, batch_blocks);
+    }
+    u32* checksums = PUSH_ARRAY(arena, u32, batch_blocks);
+
+    compress_io io = {
+        .in = in,
+        .out = out,
+        .ok = true,
+        .read_size = batch_size,
+        .slot_size = slot_size
+    };
+
+    u64 filled = read_full(in, in_buffers[0], batch_size);
+    thread_async* io_thread = thread_async_create();
+
+    for (u32 cur = 0; io.ok; cur ^= 1) {
+        b32 last = filled < batch_size;
+        u64 num_blocks = (filled + block_size - 1) / block_size;
+
+        io.read_buffer = last ? NULL : in_buffers[cur ^ 1];
+        thread_async_start(io_thread, compress_io_job, &io);
+
+        frame_compress_blocks(opts, in_buffers[cur], filled, slots[cur], comp_sizes[cur], checksums);
+        if (opts->checksum) { *checksum = frame_checksum(checksums, num_blocks, *checksum); }
+        if (list != NULL) { block_list_add(arena, list, comp_sizes[cur], num_blocks, block_size, filled); }
+
+        thread_async_wait(io_thread);
+
+        io.slots = slots[cur];
+        io.comp_sizes = comp_sizes[cur];
+        io.num_blocks = num_blocks;
+        filled = io.filled;
+
+        if (last) { break; }
+    }
+
+    thread_async_destroy(io_thread);
+
+    // The last batch is still pending
+    io.read_buffer = NULL;
+    compress_io_job(&io);
+
+    return io.ok && !ferror(in);
+}
+
+b32 stream_compress(mem_arena* arena, frame_options* opts, FILE* in, FILE* out) {
+    frame_header header;
+    frame_write_header(&header, opts->block_size, FRAME_FLAG_STREAM | (opts->checksum ? FRAME_FLAG_CHECKSUM : 0));
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    u32 checksum = 0;
+    b32 ok = write_full(out, &header, sizeof(header));
+    ok = ok && write_blocks(arena, opts, in, out, &checksum, NULL);
+
+    block_header end = { .type = BLOCK_END, .raw_size = checksum, .comp_size = 0 };
+    ok = ok && write_full(out, &end, sizeof(end));
+    ok = ok && fflush(out) == 0;
+
+    arena_temp_end(temp);
+
+    return ok;
+}
+
+static b32 file_seek(FILE* f, u64 offset) {
+#if defined(_WIN32)
+    return _fseeki64(f, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static b32 file_size(FILE* f, u64* size) {
+#if defined(_WIN32)
+    if (_fseeki64(f, 0, SEEK_END) != 0) { return false; }
+    __int64 end = _ftelli64(f);
+#else
+    if (fseeko(f, 0, SEEK_END) != 0) { return false; }
+    off_t end = ftello(f);
+#endif
+
+    if (end < 0) { return false; }
+    *size = (u64)end;
+    return true;
+}
+
+static b32 read_at(FILE* f, u64 offset, void* buffer, u64 size) {
+    return file_seek(f, offset) && read_full(f, (u8*)buffer, size) == size;
+}
+
+// Hops from block header to block header without reading the payloads.
+// Fills index when it is not NULL, returns the number of data blocks or
+// -1 if the frame is cut short. data_end is the offset of the BLOCK_END.
+static i64 walk_blocks(FILE* f, u64 size, frame_index_entry* index, u64* raw_size, u64* data_end) {
+    u64 offset = sizeof(frame_header);
+    u64 raw_offset = 0;
+    i64 num_blocks = 0;
+
+    while (offset + sizeof(block_header) <= size) {
+        block_header bh;
+        if (!read_at(f, offset, &bh, sizeof(bh))) { return -1; }
+
+        if (bh.type == BLOCK_END) {
+            *raw_size = raw_offset;
+            *data_end = offset;
+            return num_blocks;
+        }
+
+        if (bh.comp_size > size - offset - sizeof(block_header)) { return -1; }
+
+        if (index != NULL) {
+            index[num_blocks].raw_offset = raw_offset;
+            index[num_blocks].comp_offset = offset;
+        }
+
+        raw_offset += bh.raw_size;
+        num_blocks++;
+        offset += sizeof(block_header) + bh.comp_size;
+    }
+
+    return -1;
+}
+
+static b32 file_truncate(FILE* f, u64 size) {
+    if (fflush(f) != 0) { return false; }
+
+#if defined(_WIN32)
+    return _chsize_s(_fileno(f), (__int64)size) == 0;
+#else
+    return ftruncate(fileno(f), (off_t)size) == 0;
+#endif
+}
+
+// Reads the footer ending at end, if it is one and the BLOCK_INDEX
+// header in front of its seek table agrees on the size
+static b32 footer_at(FILE* f, u64 end, frame_header* header, frame_footer* footer) {
+    if (end < sizeof(frame_header) + frame_index_size(0)) { return false; }
+    if (!read_at(f, end - sizeof(*footer), footer, sizeof(*footer))) { return false; }
+    if (footer->magic != FRAME_FOOTER_MAGIC) { return false; }
+
+    u64 index_size = frame_index_size(footer->num_blocks);
+    if (index_size > end - sizeof(frame_header)) { return false; }
+
+    block_header ih;
+    return read_at(f, end - index_size, &ih, sizeof(ih)) &&
+        ih.type == BLOCK_INDEX && ih.comp_size == index_size - sizeof(block_header) &&
+        footer->raw_size <= (u64)footer->num_blocks * header->block_size;
+}
+
+// Where an indexed frame of size bytes ends: after the footer at the end
+// of the file, or if an append was cut short, after the last complete
+// seek table found by walking the block headers. The torn blocks past it
+// are not part of the frame yet.
+static b32 indexed_frame_size(FILE* f, u64 size, frame_header* header, u64* frame_size) {
+    frame_footer footer;
+    if (footer_at(f, size, header, &footer)) {
+        *frame_size = size;
+        return true;
+    }
+
+    b32 found = false;
+    u64 offset = sizeof(frame_header);
+
+    while (offset + sizeof(block_header) <= size) {
+        block_header bh;
+        if (!read_at(f, offset, &bh, sizeof(bh))) { break; }
+        if (bh.comp_size > size - offset - sizeof(block_header)) { break; }
+
+        offset += sizeof(block_header) + bh.comp_size;
+
+        if (bh.type == BLOCK_INDEX && footer_at(f, offset, header, &footer)) {
+            *frame_size = offset;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+#define STREAM_SKIP_CHUNK KiB(64)
+
+// Same pipeline as compress_io, batch i is decoded while batch i - 1 is
+// written and the block headers of batch i + 1 are read
+typedef struct {
+    FILE* in;
+    FILE* out;
+    b32 ok;
+
+    u64 block_size;
+    u64 slot_size;
+    u64 batch_blocks;
+    u8* skip_buffer;
+
+    // Reading stops once done is set
+    b32 read;
+    u8* in_buffer;
+    frame_index_entry* index;
+    u64 num_blocks;
+    u64 raw_size;
+
+    u8* out_buffer;
+    u64 out_size;
+
+    u64 remaining; // Bytes of the frame left to read, UINT64_MAX when unknown
+
+    u32 expected;
+    b32 done;
+    b32 saw_index;
+    b32 saw_end;
+} decompress_io;
+
+static u64 read_frame(decompress_io* io, u8* buffer, u64 size) {
+    u64 got = read_full(io->in, buffer, MIN(size, io->remaining));
+    io->remaining -= got;
+    return got;
+}
+
+static void read_batch(decompress_io* io) {
+    u64 comp_offset = 0;
+    io->num_blocks = 0;
+    io->raw_size = 0;
+
+    while (io->num_blocks < io->batch_blocks) {
+        block_header* bh = (block_header*)(io->in_buffer + comp_offset);
+        u64 got = read_frame(io, (u8*)bh, sizeof(block_header));
+
+        if (got == 0 && io->saw_index) { io->done = true; break; }
+        if (got != sizeof(block_header)) { io->ok = false; break; }
+        if (bh->type == BLOCK_END) {
+            io->expected = bh->raw_size;
+            io->saw_end = true;
+            io->done = true;
+            break;
+        }
+
+        if (bh->type == BLOCK_INDEX) {
+            io->expected = bh->raw_size;
+            u64 remaining = bh->comp_size;
+            while (remaining > 0 && io->ok) {
+                u64 chunk = MIN(remaining, STREAM_SKIP_CHUNK);
+                io->ok = read_frame(io, io->skip_buffer, chunk) == chunk;
+                remaining -= chunk;
+            }
+            io->saw_index = true;
+            continue;
+        }
+
+        if (bh->raw_size > io->block_size || bh->comp_size > io->slot_size - sizeof(block_header)) {
+            io->ok = false;
+            break;
+        }
+
+        if (read_frame(io, (u8*)(bh + 1), bh->comp_size) != bh->comp_size) {
+            io->ok = false;
+            break;
+        }
+
+        io->index[io->num_blocks].comp_offset = comp_offset;
+        io->index[io->num_blocks].raw_offset = io->raw_size;
+        io->num_blocks++;
+
+        comp_offset += sizeof(block_header) + bh->comp_size;
+        io->raw_size += bh->raw_size;
+    }
+}
+
+static void decompress_io_job(void* ctx) {
+    decompress_io* io = (decompress_io*)ctx;
+
+    if (io->out_size > 0 && io->ok) {
+        io->ok = write_full(io->out, io->out_buffer, io->out_size);
+    }
+    io->out_size = 0;
+
+    if (io->read && io->ok) { read_batch(io); }
+}
+
+// Also reads indexed frames front to back: index blocks are skipped and
+// the end of the input after one ends the frame. When the input is a
+// file, reading stops at the last complete footer, so blocks of an append
+// that was cut short are left out as they are by the indexed readers.
+b32 stream_decompress(mem_arena* arena, frame_options* opts, FILE* in, FILE* out) {
+    frame_header header;
+    if (read_full(in, (u8*)&header, sizeof(header)) != sizeof(header)) { return false; }
+    if (!frame_check_header(&header)) { return false; }
+
+    // Their copies can reach back further than any batch
+    if (header.flags & FRAME_FLAG_LDM) { return false; }
+
+    // Pipes cannot seek, they are read to the end
+    u64 remaining = UINT64_MAX;
+    u64 size = 0;
+    u64 frame_size = 0;
+    if (!(header.flags & FRAME_FLAG_STREAM) && file_size(in, &size)) {
+        if (indexed_frame_size(in, size, &header, &frame_size)) { remaining = frame_size - sizeof(header); }
+        if (!file_seek(in, sizeof(header))) { return false; }
+    }
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    u64 block_size = header.block_size;
+    u64 slot_size = frame_slot_size(block_size);
+    u64 batch_blocks = thread_pool_size(opts->pool);
+
+    u8* in_buffers[2];
+    u8* out_buffers[2];
+    frame_index_entry* indexes[2];
+    for (u32 i = 0; i < 2; i++) {
+        in_buffers[i] = PUSH_ARRAY_NZ(arena, u8, batch_blocks * slot_size);
+        out_buffers[i] = PUSH_ARRAY_NZ(arena, u8, batch_blocks * block_size);
+        indexes[i] = PUSH_ARRAY(arena, frame_index_entry, batch_blocks);
+    }
+    u32* checksums = PUSH_ARRAY(arena, u32, batch_blocks);
+
+    // The frame checksum is kept up to date batch by batch and compared
+    // with the one in the BLOCK_END or BLOCK_INDEX header
+    b32 has_checksum = (header.flags & FRAME_FLAG_CHECKSUM) != 0;
+    u32 checksum = 0;
+
+    decompress_io io = {
+        .in = in,
+        .out = out,
+        .ok = true,
+        .block_size = block_size,
+        .slot_size = slot_size,
+        .batch_blocks = batch_blocks,
+        .skip_buffer = PUSH_ARRAY_NZ(arena, u8, STREAM_SKIP_CHUNK),
+        .remaining = remaining,
+        .read = true,
+        .in_buffer = in_buffers[0],
+        .index = indexes[0]
+    };
+
+    read_batch(&io);
+    thread_async* io_thread = thread_async_create();
+
+    for (u32 cur = 0; io.ok; cur ^= 1) {
+        u64 num_blocks = io.num_blocks;
+        u64 raw_size = io.raw_size;
+        b32 last = io.done;
+
+        io.read = !last;
+        io.in_buffer = in_buffers[cur ^ 1];
+        io.index = indexes[cur ^ 1];
+        thread_async_start(io_thread, decompress_io_job, &io);
+
+        b32 ok = true;
+        if (num_blocks > 0) {
+            ok = frame_decompress_blocks(opts, header.flags, in_buffers[cur], indexes[cur], num_blocks, out_buffers[cur], checksums);
+            if (has_checksum) { checksum = frame_checksum(checksums, num_blocks, checksum); }
+        }
+
+        thread_async_wait(io_thread);
+
+        io.ok = io.ok && ok;
+        io.out_buffer = out_buffers[cur];
+        io.out_size = raw_size;
+
+        if (last) { break; }
+    }
+
+    thread_async_destroy(io_thread);
+
+    // The last batch is still pending
+    io.read = false;
+    decompress_io_job(&io);
+
+    b32 ok = io.ok && (!has_checksum || ((io.saw_end || io.saw_index) && checksum == io.expected));
+
+    ok = ok && fflush(out) == 0;
+
+    arena_temp_end(temp);
+
+    return ok;
+}
+
+// Loads the seek table of a frame of size bytes whose header was read:
+// from the last complete footer, or by walking the block headers of a
+// streamed frame. data_end is where the last data block ends. checksum
+// receives the frame checksum of indexed frames.
+static b32 read_seek_table(
+    mem_arena* arena, FILE* in, u64 size, frame_header* header,
+    frame_index_entry** index, u64* num_blocks, u64* raw_size, u64* data_end, u32* checksum
+) {
+    if (header->flags & FRAME_FLAG_STREAM) {
+        i64 count = walk_blocks(in, size, NULL, raw_size, data_end);
+        if (count < 0) { return false; }
+
+        *num_blocks = (u64)count;
+        *index = PUSH_ARRAY(arena, frame_index_entry, *num_blocks);
+        walk_blocks(in, size, *index, raw_size, data_end);
+
+        return true;
+    }
+
+    // The footer gives the size of the seek table right before it
+    frame_footer footer;
+    block_header index_header;
+    b32 ok = indexed_frame_size(in, size, header, &size) && footer_at(in, size, header, &footer);
+
+    if (ok) {
+        *num_blocks = footer.num_blocks;
+        *raw_size = footer.raw_size;
+        *data_end = size - frame_index_size(*num_blocks);
+        *index = PUSH_ARRAY_NZ(arena, frame_index_entry, *num_blocks);
+        ok = read_at(in, *data_end, &index_header, sizeof(index_header));
+        ok = ok && read_full(in, (u8*)*index, *num_blocks * sizeof(frame_index_entry)) == *num_blocks * sizeof(frame_index_entry);
+        *checksum = index_header.raw_size;
+    }
+
+    return ok;
+}
+
+// [start, end) of the raw data, or with from_end its last end - start bytes
+static b32 decompress_range(
+    mem_arena* arena, frame_options* opts, FILE* in, u64 start, u64 end, b32 from_end, FILE* out
+) {
+    u64 size = 0;
+    frame_header header;
+
+    if (!file_size(in, &size) || size < sizeof(header)) { return false; }
+    if (!read_at(in, 0, &header, sizeof(header)) || !frame_check_header(&header)) { return false; }
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    frame_index_entry* index = NULL;
+    u64 num_blocks = 0;
+    u64 raw_size = 0;
+    u64 data_end = 0;
+    u32 checksum = 0;
+
+    b32 ok = read_seek_table(arena, in, size, &header, &index, &num_blocks, &raw_size, &data_end, &checksum);
+
+    if (ok && from_end) {
+        u64 length = MIN(end - start, raw_size);
+        start = raw_size - length;
+        end = raw_size;
+    }
+
+    ok = ok && start <= end && end <= raw_size;
+
+    if (ok && start < end && num_blocks > 0) {
+        // Only the covering blocks are read, as one contiguous span
+        u64 first = frame_find_block(index, num_blocks, start);
+        u64 last = frame_find_block(index, num_blocks, end - 1);
+        u64 span_start = index[first].comp_offset;
+        u64 span_end = last + 1 < num_blocks ? index[last + 1].comp_offset : data_end;
+
+        ok = span_start <= span_end && span_end <= size;
+
+        if (ok) {
+            u64 count = last - first + 1;
+            u64 span_size = span_end - span_start;
+            u8* span = PUSH_ARRAY_NZ(arena, u8, span_size);
+            u8* out_buffer = PUSH_ARRAY_NZ(arena, u8, end - start);
+
+            for (u64 i = 0; i < count; i++) {
+                index[first + i].comp_offset -= span_start;
+            }
+
+            ok = read_at(in, span_start, span, span_size);
+            ok = ok && frame_decompress_span(
+                arena, opts, header.flags, span, span_size, index + first, count, start, end, out_buffer
+            );
+            ok = ok && write_full(out, out_buffer, end - start);
+        }
+    }
+
+    ok = ok && fflush(out) == 0;
+
+    arena_temp_end(temp);
+
+    return ok;
+}
+
+b32 stream_decompress_range(mem_arena* arena, frame_options* opts, FILE* in, u64 start, u64 end, FILE* out) {
+    return decompress_range(arena, opts, in, start, end, false, out);
+}
+
+b32 stream_decompress_tail(mem_arena* arena, frame_options* opts, FILE* in, u64 length, FILE* out) {
+    return decompress_range(arena, opts, in, 0, length, true, out);
+}
+
+// The new blocks go after the old seek table, followed by a new one that
+// covers every block. While they are written the file does not end with
+// a footer, readers then fall back on the last complete seek table and
+// see the frame as it was before the append. A failed append cuts the
+// file back to that, and one that was killed leaves a torn tail that the
+// next append cuts off before it writes.
+b32 stream_append(mem_arena* arena, frame_options* opts, FILE* in, FILE* frame) {
+    u64 size = 0;
+    if (!file_size(frame, &size)) { return false; }
+
+    mem_arena_temp temp = arena_temp_begin(arena);
+
+    frame_header header;
+    frame_write_header(&header, opts->block_size, opts->checksum ? FRAME_FLAG_CHECKSUM : 0);
+
+    block_list list = { .comp_offset = sizeof(header) };
+    u32 checksum = 0;
+    b32 ok = true;
+
+    if (size == 0) {
+        ok = write_full(frame, &header, sizeof(header));
+    } else {
+        // Streamed frames have no seek table to extend
+        u64 data_end = 0;
+        u64 frame_size = 0;
+        ok = read_at(frame, 0, &header, sizeof(header)) && frame_check_header(&header);
+        ok = ok && !(header.flags & FRAME_FLAG_STREAM);
+        ok = ok && indexed_frame_size(frame, size, &header, &frame_size);
+
+        if (ok && frame_size < size) {
+            ok = file_truncate(frame, frame_size);
+            size = frame_size;
+        }
+
+        ok = ok && read_seek_table(
+            arena, frame, size, &header, &list.entries, &list.count, &list.raw_offset, &data_end, &checksum
+        );
+
+        list.capacity = list.count;
+        list.comp_offset = size;
+        ok = ok && file_seek(frame, size);
+    }
+
+    // New blocks keep the block size and checksums of the frame
+    frame_options append_opts = *opts;
+    append_opts.block_size = header.block_size;
+    append_opts.checksum = (header.flags & FRAME_FLAG_CHECKSUM) != 0;
+
+    u64 old_count = list.count;
+    ok = ok && write_blocks(arena, &append_opts, in, frame, &checksum, &list);
+    ok = ok && list.count <= UINT32_MAX;
+
+    // Nothing new leaves an existing frame as it is
+    if (ok && (list.count > old_count || size == 0)) {
+        block_header index_header = {
+            .type = BLOCK_INDEX,
+            .raw_size = checksum,
+            .comp_size = (u32)(frame_index_size(list.count) - sizeof(block_header))
+        };
+        frame_footer footer = { .raw_size = list.raw_offset, .num_blocks = (u32)list.count, .magic = FRAME_FOOTER_MAGIC };
+
+        ok = write_full(frame, &index_header, sizeof(index_header));
+        ok = ok && write_full(frame, list.entries, list.count * sizeof(frame_index_entry));
+        ok = ok && write_full(frame, &footer, sizeof(footer));
+    }
+
+    ok = ok && fflush(frame) == 0;
+    if (!ok && size > 0) { file_truncate(frame, size); }
+
+    arena_temp_end(temp);
+
+    return ok;
+}
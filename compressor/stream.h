@@ -0,0 +1,33 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdio.h>
+
+#include "base.h"
+#include "arena.h"
+#include "frame.h"
+
+// Streamed frames are produced and consumed one batch of blocks at a time,
+// a block per worker, so memory stays bounded by the block size no matter
+// how long the input is. Works on pipes, nothing is ever seeked. Frames
+// with long distance matching only decode whole and are refused, and
+// opts->ldm_table_log is not used for writing.
+b32 stream_compress(mem_arena* arena, frame_options* opts, FILE* in, FILE* out);
+b32 stream_decompress(mem_arena* arena, frame_options* opts, FILE* in, FILE* out);
+
+// Writes [start, end) of the raw data to out, reading only the seek table
+// and the blocks that cover the range. in must be seekable. Streamed
+// frames have no seek table, their block headers are walked instead.
+b32 stream_decompress_range(mem_arena* arena, frame_options* opts, FILE* in, u64 start, u64 end, FILE* out);
+// The last length bytes, or all of them when there are fewer
+b32 stream_decompress_tail(mem_arena* arena, frame_options* opts, FILE* in, u64 length, FILE* out);
+
+// Codes everything read from in as new blocks at the end of the indexed
+// frame in frame, opened for reading and writing, and writes a seek table
+// for the whole frame after them. Blocks already there are never
+// rewritten, so a growing log is coded once. An empty file becomes a new
+// frame with the block size and checksums of opts, an existing frame
+// keeps its own. Readers only look at the last seek table.
+b32 stream_append(mem_arena* arena, frame_options* opts, FILE* in, FILE* frame);
+
+#endif
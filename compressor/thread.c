@@ -0,0 +1,369 @@
+#include "thread.h"
+
+#define THREAD_MAX_WORKERS 256
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+typedef HANDLE plat_thread;
+typedef CRITICAL_SECTION plat_mutex;
+typedef CONDITION_VARIABLE plat_cond;
+
+#elif defined(__linux__)
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_t plat_thread;
+typedef pthread_mutex_t plat_mutex;
+typedef pthread_cond_t plat_cond;
+
+#endif
+
+// Where a new thread starts, kept next to its handle so it outlives the
+// call that created the thread
+typedef struct {
+    thread_job_fn* fn;
+    void* ctx;
+} plat_thread_start;
+
+typedef struct {
+    thread_pool* pool;
+    mem_arena* arena;
+    plat_thread handle;
+    plat_thread_start start;
+} thread_worker;
+
+// workers[0] is the thread calling thread_pool_run, it takes tasks
+// like everyone else instead of sleeping until the run is done.
+struct thread_pool {
+    mem_arena* arena;
+    u32 num_threads;
+    thread_worker* workers;
+
+    plat_mutex mutex;
+    plat_cond work_cond;
+    plat_cond done_cond;
+
+    thread_task_fn* fn;
+    void* ctx;
+    u64 count;
+    u64 next;
+    u64 generation;
+    u32 active;
+    b32 quit;
+};
+
+struct thread_async {
+    mem_arena* arena;
+    plat_thread handle;
+    plat_thread_start start;
+
+    plat_mutex mutex;
+    plat_cond cond;
+
+    thread_job_fn* fn;
+    void* ctx;
+    b32 busy;
+    b32 quit;
+};
+
+static b32 plat_thread_create(plat_thread* thread, plat_thread_start* start);
+static void plat_thread_join(plat_thread thread);
+static void plat_mutex_init(plat_mutex* mutex);
+static void plat_mutex_destroy(plat_mutex* mutex);
+static void plat_mutex_lock(plat_mutex* mutex);
+static void plat_mutex_unlock(plat_mutex* mutex);
+static void plat_cond_init(plat_cond* cond);
+static void plat_cond_destroy(plat_cond* cond);
+static void plat_cond_wait(plat_cond* cond, plat_mutex* mutex);
+static void plat_cond_broadcast(plat_cond* cond);
+
+static void run_tasks(thread_pool* pool, mem_arena* arena) {
+    while (1) {
+        u64 index = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if (index >= pool->count) { break; }
+
+        mem_arena_temp temp = arena_temp_begin(arena);
+        pool->fn(pool->ctx, index, arena);
+        arena_temp_end(temp);
+    }
+}
+
+static void worker_main(void* ctx) {
+    thread_worker* worker = (thread_worker*)ctx;
+    thread_pool* pool = worker->pool;
+    u64 seen_generation = 0;
+
+    while (1) {
+        plat_mutex_lock(&pool->mutex);
+        while (pool->generation == seen_generation && !pool->quit) {
+            plat_cond_wait(&pool->work_cond, &pool->mutex);
+        }
+
+        if (pool->quit) {
+            plat_mutex_unlock(&pool->mutex);
+            return;
+        }
+
+        seen_generation = pool->generation;
+        plat_mutex_unlock(&pool->mutex);
+
+        run_tasks(pool, worker->arena);
+
+        plat_mutex_lock(&pool->mutex);
+        if (--pool->active == 0) {
+            plat_cond_broadcast(&pool->done_cond);
+        }
+        plat_mutex_unlock(&pool->mutex);
+    }
+}
+
+thread_pool* thread_pool_create(u32 num_threads, u64 arena_reserve) {
+    num_threads = CLAMP(num_threads, 1, THREAD_MAX_WORKERS);
+
+    mem_arena* arena = arena_create(MiB(1), KiB(64));
+    if (arena == NULL) { return NULL; }
+
+    thread_pool* pool = PUSH_STRUCT(arena, thread_pool);
+    pool->arena = arena;
+    pool->workers = PUSH_ARRAY(arena, thread_worker, num_threads);
+
+    plat_mutex_init(&pool->mutex);
+    plat_cond_init(&pool->work_cond);
+    plat_cond_init(&pool->done_cond);
+
+    for (u32 i = 0; i < num_threads; i++) {
+        thread_worker* worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->arena = arena_create(arena_reserve, MiB(1));
+        if (worker->arena == NULL) { break; }
+
+        worker->start = (plat_thread_start){ .fn = worker_main, .ctx = worker };
+        if (i > 0 && !plat_thread_create(&worker->handle, &worker->start)) {
+            arena_destroy(worker->arena);
+            break;
+        }
+
+        pool->num_threads++;
+    }
+
+    if (pool->num_threads == 0) {
+        thread_pool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+void thread_pool_destroy(thread_pool* pool) {
+    plat_mutex_lock(&pool->mutex);
+    pool->quit = true;
+    plat_cond_broadcast(&pool->work_cond);
+    plat_mutex_unlock(&pool->mutex);
+
+    for (u32 i = 0; i < pool->num_threads; i++) {
+        if (i > 0) { plat_thread_join(pool->workers[i].handle); }
+        arena_destroy(pool->workers[i].arena);
+    }
+
+    plat_cond_destroy(&pool->done_cond);
+    plat_cond_destroy(&pool->work_cond);
+    plat_mutex_destroy(&pool->mutex);
+
+    arena_destroy(pool->arena);
+}
+
+void thread_pool_run(thread_pool* pool, thread_task_fn* fn, void* ctx, u64 count) {
+    if (count == 0) { return; }
+
+    plat_mutex_lock(&pool->mutex);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->count = count;
+    pool->next = 0;
+    pool->active = pool->num_threads - 1;
+    pool->generation++;
+    plat_cond_broadcast(&pool->work_cond);
+    plat_mutex_unlock(&pool->mutex);
+
+    run_tasks(pool, pool->workers[0].arena);
+
+    plat_mutex_lock(&pool->mutex);
+    while (pool->active > 0) {
+        plat_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+    plat_mutex_unlock(&pool->mutex);
+}
+
+u32 thread_pool_size(thread_pool* pool) {
+    return pool->num_threads;
+}
+
+u64 thread_pool_peak_arena(thread_pool* pool) {
+    u64 peak = 0;
+    for (u32 i = 0; i < pool->num_threads; i++) {
+        peak = MAX(peak, pool->workers[i].arena->peak_pos - ARENA_BASE_POS);
+    }
+
+    return peak;
+}
+
+static void async_main(void* ctx) {
+    thread_async* t = (thread_async*)ctx;
+
+    plat_mutex_lock(&t->mutex);
+    while (1) {
+        while (!t->busy && !t->quit) {
+            plat_cond_wait(&t->cond, &t->mutex);
+        }
+
+        if (!t->busy) { break; }
+
+        plat_mutex_unlock(&t->mutex);
+        t->fn(t->ctx);
+        plat_mutex_lock(&t->mutex);
+
+        t->busy = false;
+        plat_cond_broadcast(&t->cond);
+    }
+    plat_mutex_unlock(&t->mutex);
+}
+
+thread_async* thread_async_create(void) {
+    mem_arena* arena = arena_create(KiB(64), KiB(4));
+    if (arena == NULL) { return NULL; }
+
+    thread_async* t = PUSH_STRUCT(arena, thread_async);
+    t->arena = arena;
+    t->start = (plat_thread_start){ .fn = async_main, .ctx = t };
+
+    plat_mutex_init(&t->mutex);
+    plat_cond_init(&t->cond);
+
+    if (!plat_thread_create(&t->handle, &t->start)) {
+        plat_cond_destroy(&t->cond);
+        plat_mutex_destroy(&t->mutex);
+        arena_destroy(arena);
+        return NULL;
+    }
+
+    return t;
+}
+
+void thread_async_destroy(thread_async* t) {
+    if (t == NULL) { return; }
+
+    plat_mutex_lock(&t->mutex);
+    t->quit = true;
+    plat_cond_broadcast(&t->cond);
+    plat_mutex_unlock(&t->mutex);
+
+    plat_thread_join(t->handle);
+
+    plat_cond_destroy(&t->cond);
+    plat_mutex_destroy(&t->mutex);
+
+    arena_destroy(t->arena);
+}
+
+void thread_async_start(thread_async* t, thread_job_fn* fn, void* ctx) {
+    if (t == NULL) {
+        fn(ctx);
+        return;
+    }
+
+    plat_mutex_lock(&t->mutex);
+    t->fn = fn;
+    t->ctx = ctx;
+    t->busy = true;
+    plat_cond_broadcast(&t->cond);
+    plat_mutex_unlock(&t->mutex);
+}
+
+void thread_async_wait(thread_async* t) {
+    if (t == NULL) { return; }
+
+    plat_mutex_lock(&t->mutex);
+    while (t->busy) {
+        plat_cond_wait(&t->cond, &t->mutex);
+    }
+    plat_mutex_unlock(&t->mutex);
+}
+
+#if defined(_WIN32)
+
+static DWORD WINAPI plat_thread_entry(LPVOID param) {
+    plat_thread_start* start = (plat_thread_start*)param;
+    start->fn(start->ctx);
+    return 0;
+}
+
+static b32 plat_thread_create(plat_thread* thread, plat_thread_start* start) {
+    *thread = CreateThread(NULL, 0, plat_thread_entry, start, 0, NULL);
+    return *thread != NULL;
+}
+
+static void plat_thread_join(plat_thread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static void plat_mutex_init(plat_mutex* mutex) { InitializeCriticalSection(mutex); }
+static void plat_mutex_destroy(plat_mutex* mutex) { DeleteCriticalSection(mutex); }
+static void plat_mutex_lock(plat_mutex* mutex) { EnterCriticalSection(mutex); }
+static void plat_mutex_unlock(plat_mutex* mutex) { LeaveCriticalSection(mutex); }
+
+static void plat_cond_init(plat_cond* cond) { InitializeConditionVariable(cond); }
+static void plat_cond_destroy(plat_cond* cond) { (void)cond; }
+
+static void plat_cond_wait(plat_cond* cond, plat_mutex* mutex) {
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+}
+
+static void plat_cond_broadcast(plat_cond* cond) { WakeAllConditionVariable(cond); }
+
+u32 plat_get_core_count(void) {
+    SYSTEM_INFO sysinfo = { 0 };
+    GetSystemInfo(&sysinfo);
+
+    return (u32)sysinfo.dwNumberOfProcessors;
+}
+
+#elif defined(__linux__)
+
+static void* plat_thread_entry(void* param) {
+    plat_thread_start* start = (plat_thread_start*)param;
+    start->fn(start->ctx);
+    return NULL;
+}
+
+static b32 plat_thread_create(plat_thread* thread, plat_thread_start* start) {
+    return pthread_create(thread, NULL, plat_thread_entry, start) == 0;
+}
+
+static void plat_thread_join(plat_thread thread) {
+    pthread_join(thread, NULL);
+}
+
+static void plat_mutex_init(plat_mutex* mutex) { pthread_mutex_init(mutex, NULL); }
+static void plat_mutex_destroy(plat_mutex* mutex) { pthread_mutex_destroy(mutex); }
+static void plat_mutex_lock(plat_mutex* mutex) { pthread_mutex_lock(mutex); }
+static void plat_mutex_unlock(plat_mutex* mutex) { pthread_mutex_unlock(mutex); }
+
+static void plat_cond_init(plat_cond* cond) { pthread_cond_init(cond, NULL); }
+static void plat_cond_destroy(plat_cond* cond) { pthread_cond_destroy(cond); }
+
+static void plat_cond_wait(plat_cond* cond, plat_mutex* mutex) {
+    pthread_cond_wait(cond, mutex);
+}
+
+static void plat_cond_broadcast(plat_cond* cond) { pthread_cond_broadcast(cond); }
+
+u32 plat_get_core_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "base.h"
+#include "arena.h"
+
+// Runs fn for every index in [0, count) on the pool's workers. Each worker
+// owns an arena, anything a task pushes onto it is popped when it returns.
+typedef void thread_task_fn(void* ctx, u64 index, mem_arena* arena);
+
+typedef struct thread_pool thread_pool;
+
+thread_pool* thread_pool_create(u32 num_threads, u64 arena_reserve);
+void thread_pool_destroy(thread_pool* pool);
+void thread_pool_run(thread_pool* pool, thread_task_fn* fn, void* ctx, u64 count);
+u32 thread_pool_size(thread_pool* pool);
+// The most any one worker arena has held at once
+u64 thread_pool_peak_arena(thread_pool* pool);
+
+// A single extra thread for blocking work, such as file I/O, that should
+// overlap with the pool. It runs one job at a time: start hands it fn,
+// wait returns once fn has finished. A NULL thread runs fn inline in
+// start, so callers can carry on when thread_async_create fails.
+typedef void thread_job_fn(void* ctx);
+
+typedef struct thread_async thread_async;
+
+thread_async* thread_async_create(void);
+void thread_async_destroy(thread_async* t);
+void thread_async_start(thread_async* t, thread_job_fn* fn, void* ctx);
+void thread_async_wait(thread_async* t);
+
+u32 plat_get_core_count(void);
+
+#endif
@@ -0,0 +1,35 @@
+#include "timer.h"
+
+f64 timer_mb_per_sec(u64 bytes, u64 elapsed_ns) {
+    if (elapsed_ns == 0) { return 0.0; }
+    return ((f64)bytes / (f64)MiB(1)) / ((f64)elapsed_ns / 1e9);
+}
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+u64 timer_now_ns(void) {
+    static LARGE_INTEGER freq = { 0 };
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+
+    return (u64)((f64)now.QuadPart * 1e9 / (f64)freq.QuadPart);
+}
+
+#elif defined(__linux__)
+
+#include <time.h>
+
+u64 timer_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+#endif
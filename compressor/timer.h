@@ -0,0 +1,9 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "base.h"
+
+u64 timer_now_ns(void);
+f64 timer_mb_per_sec(u64 bytes, u64 elapsed_ns);
+
+#endif